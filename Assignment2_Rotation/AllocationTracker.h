@@ -0,0 +1,97 @@
+#pragma once
+// Std. Includes
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iostream>
+using namespace std;
+
+// Counts calls to the global operator new while enabled. The replacement operators below are defined in this
+// header, so it must be included by exactly one translation unit (main.cpp).
+struct AllocationStats {
+    size_t count;
+    size_t bytes;
+};
+
+class AllocationTracker
+{
+    public:
+    static void Enable(bool enabled)
+    {
+        enabledFlag().store(enabled, memory_order_relaxed);
+    }
+
+    static bool Enabled()
+    {
+        return enabledFlag().load(memory_order_relaxed);
+    }
+
+    static void Reset()
+    {
+        countRef().store(0, memory_order_relaxed);
+        bytesRef().store(0, memory_order_relaxed);
+    }
+
+    static AllocationStats Stats()
+    {
+        AllocationStats stats = { countRef().load(memory_order_relaxed), bytesRef().load(memory_order_relaxed) };
+        return stats;
+    }
+
+    static void Record(size_t size)
+    {
+        if(Enabled())
+        {
+            countRef().fetch_add(1, memory_order_relaxed);
+            bytesRef().fetch_add(size, memory_order_relaxed);
+        }
+    }
+
+    private:
+    // Function statics: usable from operator new before any other static is constructed
+    static atomic<bool>& enabledFlag() { static atomic<bool> flag(false); return flag; }
+    static atomic<size_t>& countRef() { static atomic<size_t> count(0); return count; }
+    static atomic<size_t>& bytesRef() { static atomic<size_t> bytes(0); return bytes; }
+};
+
+// Counts allocations made while it's alive (and tracking is enabled), e.g. around startup loading
+class AllocationScope
+{
+    public:
+    AllocationScope() : start(AllocationTracker::Stats()) { }
+
+    AllocationStats Delta() const
+    {
+        AllocationStats now = AllocationTracker::Stats();
+        AllocationStats delta = { now.count - this->start.count, now.bytes - this->start.bytes };
+        return delta;
+    }
+
+    private:
+    AllocationStats start;
+};
+
+// Replacement operators can't be inline, so these are ordinary definitions: a second translation unit including
+// this header fails to link with duplicate symbols. Move them into a .cpp of their own if main.cpp stops being the only one.
+void* operator new(size_t size)
+{
+    AllocationTracker::Record(size);
+    void* p = malloc(size ? size : 1);
+    if(!p)
+        throw bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    AllocationTracker::Record(size);
+    void* p = malloc(size ? size : 1);
+    if(!p)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
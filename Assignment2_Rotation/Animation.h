@@ -0,0 +1,291 @@
+#pragma once
+// Std. Includes
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <assimp/scene.h>
+
+#include "SceneGraph.h"
+#include "ThreadPool.h"
+
+// One animated property (position, rotation or scale) of a node.
+// Keys are stored as flat float arrays, or as 16 bit integers relative to the track's range when quantized.
+struct AnimationTrack {
+    vector<float> times;        // Key times in seconds, ascending
+    vector<float> values;       // width floats per key, empty when quantized
+    vector<int16_t> packed;     // width shorts per key, empty when not quantized
+    GLuint width;               // 3 for position/scale, 4 for rotation (x, y, z, w)
+    float bias[4];              // Dequantization: value = bias + scale * packed
+    float scale[4];
+
+    AnimationTrack(GLuint width = 3) : width(width)
+    {
+        for(GLuint c = 0; c < 4; c++)
+        {
+            this->bias[c] = 0.0f;
+            this->scale[c] = 1.0f;
+        }
+    }
+
+    GLuint KeyCount() const
+    {
+        return (GLuint)this->times.size();
+    }
+
+    // Writes key k into out[0 .. width)
+    void Key(GLuint k, float* out) const
+    {
+        if(this->packed.empty())
+        {
+            const float* v = &this->values[k * this->width];
+            for(GLuint c = 0; c < this->width; c++)
+                out[c] = v[c];
+        }
+        else
+        {
+            const int16_t* q = &this->packed[k * this->width];
+            for(GLuint c = 0; c < this->width; c++)
+                out[c] = this->bias[c] + this->scale[c] * q[c];
+        }
+    }
+
+    // Replaces the float keys with 16 bit keys spanning each component's [min, max]
+    void Quantize()
+    {
+        GLuint count = this->KeyCount();
+        if(count == 0 || !this->packed.empty())
+            return;
+        for(GLuint c = 0; c < this->width; c++)
+        {
+            float lo = this->values[c], hi = this->values[c];
+            for(GLuint k = 1; k < count; k++)
+            {
+                lo = min(lo, this->values[k * this->width + c]);
+                hi = max(hi, this->values[k * this->width + c]);
+            }
+            this->bias[c] = 0.5f * (lo + hi);
+            this->scale[c] = hi > lo ? (hi - lo) / 65534.0f : 1.0f;
+        }
+        this->packed.resize(this->values.size());
+        for(GLuint i = 0; i < this->values.size(); i++)
+        {
+            GLuint c = i % this->width;
+            float q = (this->values[i] - this->bias[c]) / this->scale[c];
+            this->packed[i] = (int16_t)max(-32767.0f, min(32767.0f, floor(q + 0.5f)));
+        }
+        vector<float>().swap(this->values);
+    }
+
+    // Samples the track at time t. cursor is the key found by the previous call and is advanced from there,
+    // which makes forward playback O(1) amortized. Only a backwards jump falls back to a binary search.
+    void Sample(float t, uint32_t& cursor, float* out) const
+    {
+        GLuint count = this->KeyCount();
+        if(count == 1 || t <= this->times[0])
+        {
+            cursor = 0;
+            this->Key(0, out);
+            return;
+        }
+        if(t >= this->times[count - 1])
+        {
+            cursor = count - 1;
+            this->Key(count - 1, out);
+            return;
+        }
+        if(cursor >= count - 1 || t < this->times[cursor])
+            cursor = (uint32_t)(upper_bound(this->times.begin(), this->times.end(), t) - this->times.begin()) - 1;
+        while(t >= this->times[cursor + 1])
+            cursor++;
+
+        float a[4], b[4];
+        this->Key(cursor, a);
+        this->Key(cursor + 1, b);
+        float f = (t - this->times[cursor]) / (this->times[cursor + 1] - this->times[cursor]);
+        if(this->width == 4)
+        {
+            // Normalized lerp along the shorter arc
+            float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+            float sign = d < 0.0f ? -1.0f : 1.0f;
+            float len = 0.0f;
+            for(GLuint c = 0; c < 4; c++)
+            {
+                out[c] = a[c] + (sign * b[c] - a[c]) * f;
+                len += out[c] * out[c];
+            }
+            len = 1.0f / sqrt(len);
+            for(GLuint c = 0; c < 4; c++)
+                out[c] *= len;
+        }
+        else
+        {
+            for(GLuint c = 0; c < this->width; c++)
+                out[c] = a[c] + (b[c] - a[c]) * f;
+        }
+    }
+};
+
+// A set of node animation channels, each made of a position, rotation and scale track
+struct AnimationClip {
+    string name;
+    float duration;             // Seconds
+    vector<GLuint> nodes;       // Scene graph node driven by each channel
+    vector<AnimationTrack> tracks;  // 3 per channel: position, rotation, scale
+
+    GLuint ChannelCount() const
+    {
+        return (GLuint)this->nodes.size();
+    }
+
+    // Bytes held by the key arrays
+    size_t CpuBytes() const
+    {
+        size_t bytes = this->nodes.capacity() * sizeof(GLuint) + this->tracks.capacity() * sizeof(AnimationTrack);
+        for(GLuint i = 0; i < this->tracks.size(); i++)
+            bytes += this->tracks[i].times.capacity() * sizeof(float) + this->tracks[i].values.capacity() * sizeof(float)
+                   + this->tracks[i].packed.capacity() * sizeof(int16_t);
+        return bytes;
+    }
+};
+
+// Converts an ASSIMP animation into a clip. Channels whose node isn't in the graph are dropped.
+inline AnimationClip importAnimation(const aiAnimation* animation, const SceneGraph& graph, bool quantize = false)
+{
+    AnimationClip clip;
+    clip.name = animation->mName.C_Str();
+    // Not all formats store the tick rate, ASSIMP then leaves it at 0
+    double ticksPerSecond = animation->mTicksPerSecond != 0.0 ? animation->mTicksPerSecond : 25.0;
+    clip.duration = (float)(animation->mDuration / ticksPerSecond);
+    for(GLuint i = 0; i < animation->mNumChannels; i++)
+    {
+        const aiNodeAnim* channel = animation->mChannels[i];
+        GLint node = graph.FindNode(channel->mNodeName.C_Str());
+        if(node < 0 || channel->mNumPositionKeys == 0 || channel->mNumRotationKeys == 0 || channel->mNumScalingKeys == 0)
+            continue;
+        AnimationTrack position(3), rotation(4), scaling(3);
+        position.times.reserve(channel->mNumPositionKeys);
+        position.values.reserve(channel->mNumPositionKeys * 3);
+        for(GLuint k = 0; k < channel->mNumPositionKeys; k++)
+        {
+            const aiVectorKey& key = channel->mPositionKeys[k];
+            position.times.push_back((float)(key.mTime / ticksPerSecond));
+            position.values.insert(position.values.end(), { key.mValue.x, key.mValue.y, key.mValue.z });
+        }
+        rotation.times.reserve(channel->mNumRotationKeys);
+        rotation.values.reserve(channel->mNumRotationKeys * 4);
+        for(GLuint k = 0; k < channel->mNumRotationKeys; k++)
+        {
+            const aiQuatKey& key = channel->mRotationKeys[k];
+            rotation.times.push_back((float)(key.mTime / ticksPerSecond));
+            rotation.values.insert(rotation.values.end(), { key.mValue.x, key.mValue.y, key.mValue.z, key.mValue.w });
+        }
+        scaling.times.reserve(channel->mNumScalingKeys);
+        scaling.values.reserve(channel->mNumScalingKeys * 3);
+        for(GLuint k = 0; k < channel->mNumScalingKeys; k++)
+        {
+            const aiVectorKey& key = channel->mScalingKeys[k];
+            scaling.times.push_back((float)(key.mTime / ticksPerSecond));
+            scaling.values.insert(scaling.values.end(), { key.mValue.x, key.mValue.y, key.mValue.z });
+        }
+        if(quantize)
+        {
+            position.Quantize();
+            rotation.Quantize();
+            scaling.Quantize();
+        }
+        clip.nodes.push_back(node);
+        clip.tracks.push_back(position);
+        clip.tracks.push_back(rotation);
+        clip.tracks.push_back(scaling);
+    }
+    return clip;
+}
+
+// Plays one clip on many instances. Per-instance state lives in flat arrays:
+// the playback time, one cursor per track and one local transform per channel.
+class AnimationSampler
+{
+    public:
+    const AnimationClip* clip;
+    GLuint instanceCount;
+    vector<float> times;
+    vector<uint32_t> cursors;
+    vector<glm::mat4> transforms;   // transforms[instance * channels + channel]
+
+    AnimationSampler(const AnimationClip* clip = nullptr, GLuint instanceCount = 1) : clip(clip), instanceCount(instanceCount)
+    {
+        GLuint channels = clip ? clip->ChannelCount() : 0;
+        this->times.assign(instanceCount, 0.0f);
+        this->cursors.assign(instanceCount * channels * 3, 0);
+        this->transforms.assign(instanceCount * channels, glm::mat4());
+    }
+
+    // Moves every instance forward, looping at the end of the clip
+    void Advance(float deltaTime)
+    {
+        if(!this->clip || this->clip->duration <= 0.0f)
+            return;
+        for(GLuint i = 0; i < this->instanceCount; i++)
+        {
+            this->times[i] += deltaTime;
+            if(this->times[i] >= this->clip->duration)
+                this->times[i] = fmod(this->times[i], this->clip->duration);
+        }
+    }
+
+    // Samples all instances, splitting them into batches across the pool's workers if one is given
+    void Sample(ThreadPool* pool = nullptr)
+    {
+        if(!this->clip || this->clip->ChannelCount() == 0)
+            return;
+        if(pool)
+            pool->ParallelFor(this->instanceCount, 16, [this](size_t begin, size_t end) { this->sampleRange((GLuint)begin, (GLuint)end); });
+        else
+            this->sampleRange(0, this->instanceCount);
+    }
+
+    // Writes an instance's sampled transforms into the animated nodes
+    void Apply(GLuint instance, SceneGraph& graph) const
+    {
+        if(!this->clip)
+            return;
+        GLuint channels = this->clip->ChannelCount();
+        for(GLuint c = 0; c < channels; c++)
+            graph.SetLocalTransform(this->clip->nodes[c], this->transforms[instance * channels + c]);
+    }
+
+    private:
+    void sampleRange(GLuint begin, GLuint end)
+    {
+        GLuint channels = this->clip->ChannelCount();
+        for(GLuint i = begin; i < end; i++)
+        {
+            float t = this->times[i];
+            uint32_t* cursor = &this->cursors[i * channels * 3];
+            glm::mat4* out = &this->transforms[i * channels];
+            for(GLuint c = 0; c < channels; c++)
+            {
+                float p[4], r[4], s[4];
+                this->clip->tracks[c * 3 + 0].Sample(t, cursor[c * 3 + 0], p);
+                this->clip->tracks[c * 3 + 1].Sample(t, cursor[c * 3 + 1], r);
+                this->clip->tracks[c * 3 + 2].Sample(t, cursor[c * 3 + 2], s);
+                // T * R * S, built directly instead of multiplying three matrices
+                glm::mat4 m = glm::mat4_cast(glm::quat(r[3], r[0], r[1], r[2]));
+                m[0] = m[0] * s[0];
+                m[1] = m[1] * s[1];
+                m[2] = m[2] * s[2];
+                m[3] = glm::vec4(p[0], p[1], p[2], 1.0f);
+                out[c] = m;
+            }
+        }
+    }
+};
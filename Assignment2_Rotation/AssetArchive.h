@@ -0,0 +1,317 @@
+#pragma once
+// Std. Includes
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+using namespace std;
+// POSIX Includes
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "MappedFile.h"
+
+// Single-file asset pack. Layout:
+//   ArchiveHeader
+//   payloads, each starting at a multiple of ARCHIVE_ALIGNMENT
+//   ArchiveEntry[entryCount], sorted by (pathHash, path)
+//   path strings
+// The archive is memory mapped and lookups return pointers straight into the mapping, so loaders read without copying.
+
+const uint32_t ARCHIVE_MAGIC = 0x4B415041;     // "APAK"
+const uint32_t ARCHIVE_VERSION = 1;
+const uint64_t ARCHIVE_ALIGNMENT = 64;
+
+struct ArchiveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+    uint64_t tocOffset;
+    uint64_t stringsOffset;
+};
+
+struct ArchiveEntry {
+    uint64_t pathHash;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t contentHash;
+    uint32_t nameOffset;        // Into the string table
+    uint32_t nameLength;
+};
+
+// 64 bit FNV-1a, used for both path and content hashes
+inline uint64_t fnv1a(const char* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Archive keys are relative paths with '/' separators and without a leading "./"
+inline string normalizeAssetPath(const string& path)
+{
+    string normalized = path;
+    replace(normalized.begin(), normalized.end(), '\\', '/');
+    while(normalized.compare(0, 2, "./") == 0)
+        normalized.erase(0, 2);
+    return normalized;
+}
+
+class AssetArchive
+{
+    public:
+    // Maps an archive file. Returns false (and stays closed) if it's missing or malformed.
+    bool Open(const string& path)
+    {
+        this->Close();
+        if(!this->file.Open(path) || this->file.Size() < sizeof(ArchiveHeader))
+        {
+            this->file.Close();
+            return false;
+        }
+        const ArchiveHeader* header = (const ArchiveHeader*)this->file.Data();
+        if(header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION
+           || header->tocOffset > this->file.Size() || (uint64_t)header->entryCount * sizeof(ArchiveEntry) > this->file.Size() - header->tocOffset
+           || header->stringsOffset > this->file.Size())
+        {
+            cout << "ERROR::ARCHIVE::INVALID " << path << endl;
+            this->file.Close();
+            return false;
+        }
+        // Every payload and name has to lie inside the mapping, or lookups and loaders would read past it
+        const ArchiveEntry* toc = (const ArchiveEntry*)(this->file.Data() + header->tocOffset);
+        uint64_t fileSize = this->file.Size();
+        for(uint32_t i = 0; i < header->entryCount; i++)
+            if(toc[i].offset > fileSize || toc[i].size > fileSize - toc[i].offset
+               || toc[i].nameOffset > fileSize - header->stringsOffset || toc[i].nameLength > fileSize - header->stringsOffset - toc[i].nameOffset)
+            {
+                cout << "ERROR::ARCHIVE::ENTRY_OUT_OF_RANGE " << path << " (entry " << i << ")" << endl;
+                this->file.Close();
+                return false;
+            }
+        this->entries = toc;
+        this->entryCount = header->entryCount;
+        this->strings = this->file.Data() + header->stringsOffset;
+        return true;
+    }
+
+    void Close()
+    {
+        this->file.Close();
+        this->entries = nullptr;
+        this->entryCount = 0;
+        this->strings = nullptr;
+    }
+
+    bool IsOpen() const
+    {
+        return this->entries != nullptr;
+    }
+
+    // Binary search on the path hash, names are only compared for entries with an equal hash
+    const ArchiveEntry* Find(const string& path) const
+    {
+        if(!this->IsOpen())
+            return nullptr;
+        string key = normalizeAssetPath(path);
+        uint64_t hash = fnv1a(key.data(), key.size());
+        const ArchiveEntry* end = this->entries + this->entryCount;
+        const ArchiveEntry* entry = lower_bound(this->entries, end, hash, [](const ArchiveEntry& e, uint64_t h) { return e.pathHash < h; });
+        for(; entry != end && entry->pathHash == hash; entry++)
+            if(entry->nameLength == key.size() && memcmp(this->strings + entry->nameOffset, key.data(), key.size()) == 0)
+                return entry;
+        return nullptr;
+    }
+
+    // Points data at the asset's bytes inside the mapping
+    bool Lookup(const string& path, const char*& data, size_t& size) const
+    {
+        const ArchiveEntry* entry = this->Find(path);
+        if(!entry)
+            return false;
+        data = this->file.Data() + entry->offset;
+        size = (size_t)entry->size;
+        return true;
+    }
+
+    // Recomputes every content hash and reports the entries that don't match, returns how many there are
+    uint32_t Verify() const
+    {
+        uint32_t corrupt = 0;
+        for(uint32_t i = 0; i < this->entryCount; i++)
+            if(fnv1a(this->file.Data() + this->entries[i].offset, (size_t)this->entries[i].size) != this->entries[i].contentHash)
+            {
+                cout << "ERROR::ARCHIVE::CORRUPT_ENTRY " << this->EntryName(i) << endl;
+                corrupt++;
+            }
+        return corrupt;
+    }
+
+    uint32_t EntryCount() const
+    {
+        return this->entryCount;
+    }
+
+    string EntryName(uint32_t i) const
+    {
+        return string(this->strings + this->entries[i].nameOffset, this->entries[i].nameLength);
+    }
+
+    private:
+    MappedFile file;
+    const ArchiveEntry* entries = nullptr;
+    uint32_t entryCount = 0;
+    const char* strings = nullptr;
+};
+
+// The archive the loaders consult before falling back to loose files
+inline AssetArchive& assetArchive()
+{
+    static AssetArchive archive;
+    return archive;
+}
+
+// Read-only view of an asset's bytes: inside the archive mapping if it's packed, otherwise a mapping of the loose file
+class AssetData
+{
+    public:
+    bool Open(const string& path)
+    {
+        this->file.Close();
+        if(assetArchive().Lookup(path, this->data, this->size))
+            return true;
+        if(!this->file.Open(path))
+        {
+            this->data = nullptr;
+            this->size = 0;
+            return false;
+        }
+        this->data = this->file.Data();
+        this->size = this->file.Size();
+        return true;
+    }
+
+    const char* Data() const { return this->data; }
+    size_t Size() const { return this->size; }
+
+    private:
+    MappedFile file;
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+// Appends path if it's a regular file, or every regular file below it if it's a directory. Returns false if it's neither.
+// POSIX rather than std::filesystem, which Apple's libc++ only provides from macOS 10.15.
+inline bool collectAssetFiles(const string& path, vector<string>& files)
+{
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0)
+        return false;
+    if(S_ISREG(info.st_mode))
+    {
+        files.push_back(normalizeAssetPath(path));
+        return true;
+    }
+    if(!S_ISDIR(info.st_mode))
+        return false;
+    DIR* directory = opendir(path.c_str());
+    if(!directory)
+        return false;
+    while(dirent* entry = readdir(directory))
+    {
+        string name = entry->d_name;
+        if(name != "." && name != "..")
+            collectAssetFiles(path.back() == '/' ? path + name : path + '/' + name, files);
+    }
+    closedir(directory);
+    return true;
+}
+
+// Packs the given files and directories (recursively) into an archive. Paths are stored as given, relative to the working directory.
+inline bool writeAssetArchive(const string& output, const vector<string>& inputs)
+{
+    vector<string> files;
+    for(const string& input : inputs)
+        if(!collectAssetFiles(input, files))
+            cout << "ERROR::ARCHIVE::NOT_FOUND " << input << endl;
+    sort(files.begin(), files.end());
+    files.erase(unique(files.begin(), files.end()), files.end());
+    // Don't pack a previous version of the archive into itself
+    files.erase(remove(files.begin(), files.end(), normalizeAssetPath(output)), files.end());
+
+    ofstream out(output, ios::binary | ios::trunc);
+    if(!out)
+    {
+        cout << "ERROR::ARCHIVE::CANNOT_WRITE " << output << endl;
+        return false;
+    }
+    ArchiveHeader header = { ARCHIVE_MAGIC, ARCHIVE_VERSION, (uint32_t)files.size(), 0, 0, 0 };
+    out.write((const char*)&header, sizeof(header));
+    uint64_t position = sizeof(header);
+
+    vector<ArchiveEntry> entries;
+    string strings;
+    const char zeros[ARCHIVE_ALIGNMENT] = { 0 };
+    for(const string& name : files)
+    {
+        MappedFile file;
+        if(!file.Open(name))
+        {
+            cout << "ERROR::ARCHIVE::CANNOT_READ " << name << endl;
+            return false;
+        }
+        uint64_t padding = (ARCHIVE_ALIGNMENT - position % ARCHIVE_ALIGNMENT) % ARCHIVE_ALIGNMENT;
+        out.write(zeros, padding);
+        position += padding;
+        ArchiveEntry entry;
+        entry.pathHash = fnv1a(name.data(), name.size());
+        entry.offset = position;
+        entry.size = file.Size();
+        entry.contentHash = fnv1a(file.Data(), file.Size());
+        entry.nameOffset = (uint32_t)strings.size();
+        entry.nameLength = (uint32_t)name.size();
+        strings += name;
+        out.write(file.Data(), file.Size());
+        position += file.Size();
+        entries.push_back(entry);
+    }
+    sort(entries.begin(), entries.end(), [&strings](const ArchiveEntry& a, const ArchiveEntry& b)
+    {
+        if(a.pathHash != b.pathHash)
+            return a.pathHash < b.pathHash;
+        return strings.compare(a.nameOffset, a.nameLength, strings, b.nameOffset, b.nameLength) < 0;
+    });
+    uint64_t padding = (ARCHIVE_ALIGNMENT - position % ARCHIVE_ALIGNMENT) % ARCHIVE_ALIGNMENT;
+    out.write(zeros, padding);
+    position += padding;
+    header.tocOffset = position;
+    if(!entries.empty())
+        out.write((const char*)entries.data(), entries.size() * sizeof(ArchiveEntry));
+    position += entries.size() * sizeof(ArchiveEntry);
+    header.stringsOffset = position;
+    out.write(strings.data(), strings.size());
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+    out.close();
+    if(!out)
+    {
+        cout << "ERROR::ARCHIVE::CANNOT_WRITE " << output << endl;
+        return false;
+    }
+    // Read the archive back through the loader's path, so a bad write fails here rather than at the next startup
+    AssetArchive written;
+    if(!written.Open(output) || written.EntryCount() != files.size() || written.Verify() > 0)
+    {
+        cout << "ERROR::ARCHIVE::VERIFY_FAILED " << output << endl;
+        return false;
+    }
+    cout << "Packed " << files.size() << " files into " << output << " (" << (position + strings.size()) / 1024 << " KB)" << endl;
+    return true;
+}
@@ -0,0 +1,580 @@
+#pragma once
+// Std. Includes
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+using namespace std;
+// GL Includes
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "SceneGraph.h"
+#include "Animation.h"
+#include "ThreadPool.h"
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "AssetArchive.h"
+#include "OcclusionCuller.h"
+#include "Meshlets.h"
+#include "MeshDeformer.h"
+#include "Model.h"
+#include "Skybox.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+// Micro benchmarks for the CPU-side subsystems. Run with: Assignment2_Rotation --bench <name>
+
+// Wall clock stopwatch reporting milliseconds
+class BenchTimer
+{
+    public:
+    BenchTimer() : start(chrono::high_resolution_clock::now()) { }
+
+    double ElapsedMs() const
+    {
+        return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - this->start).count();
+    }
+
+    private:
+    chrono::high_resolution_clock::time_point start;
+};
+
+// Update cost of the scene graph as a function of hierarchy size and the fraction of nodes touched per frame
+inline void benchSceneGraph()
+{
+    const GLuint sizes[] = { 1024, 16384, 262144 };
+    const float dirtyFractions[] = { 0.0f, 0.01f, 0.1f, 0.5f, 1.0f };
+    const int frames = 50;
+    mt19937 rng(1234);
+
+    cout << "nodes      dirty    ms/update   ns/node" << endl;
+    for(GLuint size : sizes)
+    {
+        // Random tree: each node picks a parent among the last few nodes, which keeps depth realistic (~log n)
+        SceneGraph graph;
+        graph.AddNode(-1, "root", glm::mat4());
+        vector<GLuint> open(1, 0);
+        for(GLuint i = 1; i < size; i++)
+        {
+            GLuint depthBack = rng() % open.size();
+            GLint p = open[open.size() - 1 - depthBack];
+            open.resize(open.size() - depthBack);
+            GLuint node = graph.AddNode(p, "", glm::translate(glm::mat4(), glm::vec3(1.0f, 0.0f, 0.0f)));
+            if(open.size() < 16)
+            open.push_back(node);
+        }
+        graph.Update();
+
+        for(float fraction : dirtyFractions)
+        {
+            GLuint touched = (GLuint)(fraction * size);
+            double total = 0.0;
+            for(int f = 0; f < frames; f++)
+            {
+                for(GLuint k = 0; k < touched; k++)
+                graph.SetLocalTransform(rng() % size, glm::rotate(glm::mat4(), 0.01f * f, glm::vec3(0.0f, 1.0f, 0.0f)));
+                BenchTimer timer;
+                graph.Update();
+                total += timer.ElapsedMs();
+            }
+            double ms = total / frames;
+            cout << fixed << setw(8) << size << "  " << setw(6) << setprecision(1) << fraction * 100.0f << "%  "
+                 << setw(10) << setprecision(4) << ms << "  " << setw(8) << setprecision(2) << ms * 1e6 / size << endl;
+        }
+    }
+}
+
+// Sampled channels per second for many instances of a synthetic clip, float vs quantized keys and 1 vs all threads
+inline void benchAnimation()
+{
+    const GLuint channels = 64, keys = 240, instanceCounts[] = { 1, 64, 1024, 8192 };
+    const float duration = 8.0f, frameTime = 1.0f / 60.0f;
+    const int frames = 120;
+    mt19937 rng(42);
+    uniform_real_distribution<float> value(-1.0f, 1.0f);
+
+    SceneGraph graph;
+    AnimationClip clip;
+    clip.duration = duration;
+    for(GLuint c = 0; c < channels; c++)
+    {
+        clip.nodes.push_back(graph.AddNode(c == 0 ? -1 : 0, "", glm::mat4()));
+        for(GLuint width : { 3u, 4u, 3u })
+        {
+            AnimationTrack track(width);
+            for(GLuint k = 0; k < keys; k++)
+            {
+                track.times.push_back(duration * k / (keys - 1));
+                for(GLuint w = 0; w < width; w++)
+                track.values.push_back(value(rng));
+            }
+            clip.tracks.push_back(track);
+        }
+    }
+    AnimationClip quantized = clip;
+    for(GLuint i = 0; i < quantized.tracks.size(); i++)
+        quantized.tracks[i].Quantize();
+
+    ThreadPool& pool = workerPool();
+    cout << "instances  keys       threads   Mchannels/s" << endl;
+    for(GLuint instances : instanceCounts)
+        for(int q = 0; q < 2; q++)
+            for(int threaded = 0; threaded < 2; threaded++)
+            {
+                AnimationSampler sampler(q ? &quantized : &clip, instances);
+                // Stagger the instances so they don't all hit the same keys
+                for(GLuint i = 0; i < instances; i++)
+                sampler.times[i] = duration * (i % 97) / 97.0f;
+                BenchTimer timer;
+                for(int f = 0; f < frames; f++)
+                {
+                    sampler.Advance(frameTime);
+                    sampler.Sample(threaded ? &pool : nullptr);
+                }
+                double seconds = timer.ElapsedMs() / 1000.0;
+                cout << fixed << setw(9) << instances << "  " << setw(9) << (q ? "int16" : "float") << "  " << setw(7) << (threaded ? pool.WorkerCount() + 1 : 1)
+                     << "  " << setw(12) << setprecision(2) << (double)instances * channels * frames / seconds / 1e6 << endl;
+            }
+}
+
+// OBJ parse throughput of the native importer (single threaded and on the pool) against ASSIMP with the flags Model uses
+inline void benchObj(const vector<string>& files)
+{
+    const int runs = 5;
+    cout << "file                              MB     serial MB/s   parallel MB/s   assimp MB/s" << endl;
+    for(const string& path : files)
+    {
+        MappedFile file(path);
+        double megabytes = file.Size() / (1024.0 * 1024.0);
+        file.Close();
+        double best[3] = { 1e30, 1e30, 1e30 };
+        for(int r = 0; r < runs; r++)
+        {
+            {
+                ObjScene scene;
+                BenchTimer timer;
+                loadObj(path, scene, nullptr);
+                best[0] = min(best[0], timer.ElapsedMs());
+            }
+            {
+                ObjScene scene;
+                BenchTimer timer;
+                loadObj(path, scene, &workerPool());
+                best[1] = min(best[1], timer.ElapsedMs());
+            }
+            {
+                Assimp::Importer importer;
+                BenchTimer timer;
+                importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+                best[2] = min(best[2], timer.ElapsedMs());
+            }
+        }
+        cout << fixed << left << setw(32) << path << right << setw(6) << setprecision(2) << megabytes;
+        for(int k = 0; k < 3; k++)
+            cout << setw(15) << setprecision(1) << megabytes / (best[k] / 1000.0);
+        cout << endl;
+    }
+}
+
+// Asks the OS to drop a file from the page cache, so the next read comes from disk.
+// Linux only; on macOS run "sudo purge" before the benchmark to get the cold numbers.
+inline void evictFromCache(const string& path)
+{
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd >= 0)
+    {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+// Time to open and read every asset of the archive as loose files (ifstream, like the loaders used to) vs out of the mapped archive.
+// The first pass follows a cache eviction (cold), the rest are warm.
+inline void benchStartup(const string& archivePath)
+{
+    AssetArchive archive;
+    if(!archive.Open(archivePath))
+    {
+        cout << "Build the archive first: Assignment2_Rotation --pack " << archivePath << " <assets...>" << endl;
+        return;
+    }
+    if(archive.Verify() > 0)
+    {
+        cout << "Archive is corrupt, rebuild it with --pack" << endl;
+        return;
+    }
+    vector<string> names;
+    for(uint32_t i = 0; i < archive.EntryCount(); i++)
+        names.push_back(archive.EntryName(i));
+    archive.Close();
+
+    const int passes = 5;
+    cout << "pass    loose ms   archive ms   (" << names.size() << " files)" << endl;
+    for(int pass = 0; pass < passes; pass++)
+    {
+        if(pass == 0)
+        {
+            for(const string& name : names)
+                evictFromCache(name);
+            evictFromCache(archivePath);
+        }
+        // Touch every byte so both sides actually fault the data in
+        uint64_t checksum = 0;
+        BenchTimer looseTimer;
+        for(const string& name : names)
+        {
+            ifstream file(name, ios::binary);
+            stringstream contents;
+            contents << file.rdbuf();
+            string bytes = contents.str();
+            checksum += fnv1a(bytes.data(), bytes.size());
+        }
+        double looseMs = looseTimer.ElapsedMs();
+
+        BenchTimer archiveTimer;
+        AssetArchive packed;
+        packed.Open(archivePath);
+        for(const string& name : names)
+        {
+            const char* data;
+            size_t size;
+            if(packed.Lookup(name, data, size))
+                checksum -= fnv1a(data, size);
+        }
+        double archiveMs = archiveTimer.ElapsedMs();
+        cout << fixed << setw(4) << (pass == 0 ? "cold" : "warm") << setw(12) << setprecision(2) << looseMs << setw(13) << archiveMs
+             << (checksum != 0 ? "   CONTENT MISMATCH" : "") << endl;
+    }
+}
+
+// Occlusion culler cost: a wall of occluder triangles in front of a grid of boxes, rasterized at a few
+// resolutions on one thread and on the pool
+inline void benchOcclusion()
+{
+    const GLint resolutions[][2] = { { 128, 64 }, { 256, 128 }, { 512, 256 } };
+    const GLuint wallCells = 48, boxes = 4096;
+    const int frames = 50;
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 2.0f, 0.1f, 100.0f)
+                             * glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // Wall of wallCells^2 quads at z = 2 with a hole in every 31st cell, boxes on a grid behind it
+    vector<glm::vec3> positions;
+    vector<GLuint> indices;
+    for(GLuint y = 0; y < wallCells; y++)
+        for(GLuint x = 0; x < wallCells; x++)
+        {
+            if((x * wallCells + y) % 31 == 0)
+            continue;
+            GLfloat x0 = -6.0f + 12.0f * x / wallCells, x1 = -6.0f + 12.0f * (x + 1) / wallCells;
+            GLfloat y0 = -3.0f + 6.0f * y / wallCells, y1 = -3.0f + 6.0f * (y + 1) / wallCells;
+            GLuint base = (GLuint)positions.size();
+            positions.push_back(glm::vec3(x0, y0, 2.0f));
+            positions.push_back(glm::vec3(x1, y0, 2.0f));
+            positions.push_back(glm::vec3(x1, y1, 2.0f));
+            positions.push_back(glm::vec3(x0, y1, 2.0f));
+            GLuint quad[] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    vector<glm::mat4> placements;
+    for(GLuint i = 0; i < boxes; i++)
+        placements.push_back(glm::translate(glm::mat4(), glm::vec3(-8.0f + 16.0f * (i % 64) / 63.0f, -4.0f + 8.0f * (i / 64) / 63.0f, -2.0f)));
+
+    ThreadPool& pool = workerPool();
+    cout << "resolution  threads   raster ms   test us/box   occluded" << endl;
+    for(const GLint* resolution : resolutions)
+        for(int threaded = 0; threaded < 2; threaded++)
+        {
+            OcclusionCuller culler(resolution[0], resolution[1]);
+            double rasterMs = 0.0, testMs = 0.0;
+            GLuint occluded = 0;
+            for(int f = 0; f < frames; f++)
+            {
+                BenchTimer rasterTimer;
+                culler.BeginFrame(viewProjection);
+                culler.AddOccluder(glm::mat4(), positions.data(), positions.size(), indices.data(), indices.size());
+                culler.Rasterize(threaded ? &pool : nullptr);
+                rasterMs += rasterTimer.ElapsedMs();
+                BenchTimer testTimer;
+                occluded = 0;
+                for(GLuint i = 0; i < boxes; i++)
+                occluded += culler.TestBox(placements[i], glm::vec3(-0.05f), glm::vec3(0.05f)) == CULL_OCCLUDED;
+                testMs += testTimer.ElapsedMs();
+            }
+            cout << fixed << setw(5) << resolution[0] << "x" << left << setw(4) << resolution[1] << right << "  " << setw(7) << (threaded ? pool.WorkerCount() + 1 : 1)
+                 << "  " << setw(10) << setprecision(3) << rasterMs / frames << "  " << setw(12) << testMs * 1000.0 / frames / boxes
+                 << "  " << setw(6) << occluded << "/" << boxes << endl;
+        }
+}
+
+// Meshlet build time and the share of triangles back-facing cluster culling rejects, from eight viewpoints
+// around each model plus above and below it. Like the renderer, only closed meshes get meshlets.
+inline void benchMeshlets(const vector<string>& files)
+{
+    const int runs = 20;
+    const glm::vec3 directions[] = { glm::vec3(1, 0, 0), glm::vec3(1, 0, 1), glm::vec3(0, 0, 1), glm::vec3(-1, 0, 1), glm::vec3(-1, 0, 0),
+                                     glm::vec3(-1, 0, -1), glm::vec3(0, 0, -1), glm::vec3(1, 0, -1), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0) };
+    for(const string& path : files)
+    {
+        ObjScene scene;
+        if(!loadObj(path, scene, &workerPool()))
+        {
+            cout << path << ": could not be loaded" << endl;
+            continue;
+        }
+        vector<MeshletSet> sets(scene.meshes.size());
+        BenchTimer buildTimer;
+        glm::vec3 boundsMin(1e30f), boundsMax(-1e30f);
+        GLuint meshletCount = 0, closedMeshes = 0;
+        for(size_t i = 0; i < scene.meshes.size(); i++)
+        {
+            if(MeshletSet::IsClosed(scene.meshes[i].vertices, scene.meshes[i].indices))
+            {
+                MeshletSet::SortByFacing(scene.meshes[i].vertices, scene.meshes[i].indices);
+                sets[i].Build(scene.meshes[i].vertices, scene.meshes[i].indices);
+                meshletCount += sets[i].Count();
+                closedMeshes++;
+            }
+            for(const Vertex& vertex : scene.meshes[i].vertices)
+            {
+                boundsMin = glm::min(boundsMin, vertex.Position);
+                boundsMax = glm::max(boundsMax, vertex.Position);
+            }
+        }
+        double buildMs = buildTimer.ElapsedMs();
+        cout << path << ": " << closedMeshes << " of " << scene.meshes.size() << " meshes closed, " << meshletCount << " meshlets, built in "
+             << fixed << setprecision(2) << buildMs << " ms" << endl;
+        cout << "viewpoint            meshlets culled   triangles culled   draws   cull us" << endl;
+
+        GLuint largest = 0;
+        for(const MeshletSet& set : sets)
+            largest = max(largest, set.Count());
+        vector<GLsizei> counts(largest);
+        vector<const void*> offsets(largest);
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        GLfloat distance = glm::length(boundsMax - boundsMin) * 1.5f;
+        for(const glm::vec3& direction : directions)
+        {
+            glm::vec3 viewer = center + glm::normalize(direction) * distance;
+            MeshletStats stats;
+            BenchTimer cullTimer;
+            for(int r = 0; r < runs; r++)
+            {
+                stats.Reset();
+                for(const MeshletSet& set : sets)
+                    set.Cull(viewer, counts.data(), offsets.data(), stats);
+            }
+            double cullUs = cullTimer.ElapsedMs() * 1000.0 / runs;
+            cout << "(" << setw(2) << (int)direction.x << "," << setw(2) << (int)direction.y << "," << setw(2) << (int)direction.z << ")"
+                 << setw(20) << setprecision(1) << 100.0 * stats.culledMeshlets / max(stats.meshlets, 1u) << "%"
+                 << setw(18) << 100.0 * stats.culledTriangles / max(stats.triangles, 1u) << "%"
+                 << setw(8) << stats.draws << setw(10) << setprecision(2) << cullUs << endl;
+        }
+    }
+}
+
+// CPU deformation throughput on a grid mesh with four morph targets and rotor flex: scalar and SSE,
+// on one thread and on the pool, written to a buffer standing in for the mapped vertex stream
+inline void benchDeform()
+{
+    const GLuint sizes[] = { 16384, 262144, 1048576 };
+    const int frames = 20;
+    cout << "vertices   path    threads   ms/frame   vertices/ms   write GB/s" << endl;
+    for(GLuint vertexCount : sizes)
+    {
+        GLuint side = (GLuint)sqrt((double)vertexCount);
+        vector<Vertex> vertices(vertexCount);
+        for(GLuint i = 0; i < vertexCount; i++)
+        {
+            vertices[i].Position = glm::vec3((GLfloat)(i % side) / side - 0.5f, 0.0f, (GLfloat)(i / side) / side - 0.5f);
+            vertices[i].Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+        MeshDeformer deformer(vertices);
+        for(GLuint t = 0; t < 4; t++)
+        {
+            MorphShape shape;
+            for(GLuint i = 0; i < vertexCount; i++)
+            {
+                shape.positions.push_back(vertices[i].Position + glm::vec3(0.0f, 0.1f * sin(i * 0.01f * (t + 1)), 0.0f));
+                shape.normals.push_back(glm::normalize(glm::vec3(0.1f * t, 1.0f, 0.0f)));
+            }
+            deformer.AddMorphTarget(shape);
+            deformer.weights[t] = 0.25f * (t + 1);
+        }
+        deformer.SetFlex(RotorFlex{ glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.1f, 6.0f });
+        vector<GLfloat> out(deformer.OutputBytes() / sizeof(GLfloat));
+
+        ThreadPool& pool = workerPool();
+        for(int simd = 0; simd < 2; simd++)
+            for(int threaded = 0; threaded < 2; threaded++)
+            {
+                BenchTimer timer;
+                for(int f = 0; f < frames; f++)
+                {
+                    GLfloat time = f / 60.0f;
+                    auto job = [&](size_t begin, size_t end)
+                    {
+                        for(size_t b = begin; b < end; b++)
+                        deformer.Deform(time, out.data(), (GLuint)b * 4096, min((GLuint)b * 4096 + 4096, vertexCount), simd != 0);
+                    };
+                    size_t jobs = (vertexCount + 4095) / 4096;
+                    if(threaded)
+                    pool.ParallelFor(jobs, 1, job);
+                    else
+                    job(0, jobs);
+                }
+                double ms = timer.ElapsedMs() / frames;
+                cout << fixed << setw(8) << vertexCount << "   " << setw(6) << (simd ? "sse" : "scalar") << "  " << setw(7) << (threaded ? pool.WorkerCount() + 1 : 1)
+                     << "  " << setw(9) << setprecision(3) << ms << "  " << setw(12) << setprecision(0) << vertexCount / ms
+                     << "  " << setw(11) << setprecision(2) << deformer.OutputBytes() / (ms / 1000.0) / 1e9 << endl;
+            }
+    }
+}
+
+// Model::Import through ASSIMP by stage (parse, parallel mesh conversion, parallel texture decode) as the thread count grows
+inline void benchImport(const vector<string>& files)
+{
+    const int runs = 3;
+    vector<unsigned int> threadCounts = { 1, 2, 4, 8 };
+    if(find(threadCounts.begin(), threadCounts.end(), thread::hardware_concurrency()) == threadCounts.end())
+        threadCounts.push_back(thread::hardware_concurrency());
+    cout << "file                            threads   parse ms   convert ms   decode ms   total ms" << endl;
+    for(const string& path : files)
+        for(unsigned int threads : threadCounts)
+        {
+            if(threads == 0)
+                continue;
+            ThreadPool pool(threads - 1);
+            ImportTimings best = { 1e30f, 1e30f, 1e30f };
+            bool loaded = true;
+            for(int r = 0; r < runs && loaded; r++)
+            {
+                // ASSIMP even for OBJ files, the native importer has its own benchmark
+                Model model;
+                model.nativeObj = false;
+                loaded = model.Import(path, &pool);
+                best.parseMs = min(best.parseMs, model.importTimings.parseMs);
+                best.convertMs = min(best.convertMs, model.importTimings.convertMs);
+                best.decodeMs = min(best.decodeMs, model.importTimings.decodeMs);
+            }
+            if(!loaded)
+            {
+                cout << path << ": could not be loaded" << endl;
+                break;
+            }
+            cout << fixed << left << setw(32) << path << right << setw(7) << threads << setprecision(2) << setw(11) << best.parseMs
+                 << setw(13) << best.convertMs << setw(12) << best.decodeMs << setw(11) << best.parseMs + best.convertMs + best.decodeMs << endl;
+        }
+}
+
+// Skybox load time: the six faces decoded one after another as startup used to, the first (cache building) Import
+// and a cached Import, plus the error the DXT1 compression adds to level 0
+inline void benchSkybox(const string& directory)
+{
+    const int runs = 3;
+    vector<string> faces;
+    for(const char* name : { "xpos", "xneg", "ypos", "yneg", "zpos", "zneg" })
+        faces.push_back(directory + "/" + name + ".jpg");
+    string cachePath = directory + "/skybox.bench.cube";
+    double serialMs = 1e30;
+    vector<TextureImage> images(faces.size());
+    for(int r = 0; r < runs; r++)
+    {
+        BenchTimer timer;
+        for(size_t i = 0; i < faces.size(); i++)
+            images[i] = decodeImage(faces[i]);
+        serialMs = min(serialMs, timer.ElapsedMs());
+    }
+    if(!images[0].pixels)
+    {
+        cout << directory << ": faces could not be loaded" << endl;
+        return;
+    }
+
+    SkyboxTimings built = { 0.0f, 0.0f, 0.0f, 1e30f, false }, cached = built;
+    size_t compressedBytes = 0;
+    for(int r = 0; r < runs; r++)
+    {
+        remove(cachePath.c_str());
+        Skybox sky;
+        if(!sky.Import(faces, cachePath))
+            return;
+        if(sky.timings.loadMs < built.loadMs)
+            built = sky.timings;
+        compressedBytes = sky.CompressedBytes();
+    }
+    for(int r = 0; r < runs; r++)
+    {
+        Skybox sky;
+        sky.Import(faces, cachePath);
+        if(sky.timings.loadMs < cached.loadMs)
+            cached = sky.timings;
+    }
+    remove(cachePath.c_str());
+
+    // Round trip of level 0 through the encoder
+    GLuint size = (GLuint)images[0].width;
+    vector<GLubyte> blocks((size_t)((size + 3) / 4) * ((size + 3) / 4) * 8), decoded((size_t)size * size * 3);
+    double squaredError = 0.0;
+    for(const TextureImage& image : images)
+    {
+        Skybox::compressLevel(image.pixels, size, blocks.data());
+        Skybox::decompressLevel(blocks.data(), size, decoded.data());
+        for(size_t i = 0; i < decoded.size(); i++)
+            squaredError += ((double)decoded[i] - image.pixels[i]) * ((double)decoded[i] - image.pixels[i]);
+    }
+    double psnr = 10.0 * log10(255.0 * 255.0 / max(squaredError / (decoded.size() * images.size()), 1e-9));
+
+    size_t uncompressedBytes = (size_t)size * size * 4 * 6;
+    cout << fixed << setprecision(2) << "faces " << size << "x" << size << ", worker threads " << workerPool().WorkerCount() << endl
+         << "serial decode, no mipmaps      " << setw(9) << serialMs << " ms  " << uncompressedBytes / 1024 << " KB on the GPU" << endl
+         << "parallel decode + DXT1 (build) " << setw(9) << built.loadMs << " ms  (decode " << built.decodeMs << ", compress " << built.compressMs
+         << ", hash " << built.hashMs << ")" << endl
+         << "cached                         " << setw(9) << cached.loadMs << " ms  " << compressedBytes / 1024 << " KB on the GPU with mipmaps" << endl
+         << "DXT1 level 0 PSNR " << setprecision(1) << psnr << " dB" << endl;
+}
+
+// Dispatches "--bench <name> [args]", returns the process exit code
+inline int runBenchmark(const string& name, const vector<string>& args)
+{
+    if(name == "scenegraph")
+        benchSceneGraph();
+    else if(name == "animation")
+        benchAnimation();
+    else if(name == "startup")
+        benchStartup(args.empty() ? "assets.pak" : args[0]);
+    else if(name == "occlusion")
+        benchOcclusion();
+    else if(name == "import")
+        benchImport(args.empty() ? vector<string>{ "nanosuit/nanosuit.obj", "FC15/FC15.obj" } : args);
+    else if(name == "deform")
+        benchDeform();
+    else if(name == "meshlets")
+        benchMeshlets(args.empty() ? vector<string>{ "cat.obj", "plane.obj", "nanosuit/nanosuit.obj" } : args);
+    else if(name == "skybox")
+        benchSkybox(args.empty() ? "skybox" : args[0]);
+    else if(name == "obj")
+        benchObj(args.empty() ? vector<string>{ "cat.obj", "plane.obj", "untitled.obj", "nanosuit/nanosuit.obj" } : args);
+    else
+    {
+        cout << "Unknown benchmark: " << name << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+#pragma once
+// Std. Includes
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+
+#include "GLHandle.h"
+
+// Measured state of the resolution controller, for on-screen or log output
+struct ResolutionTelemetry {
+    GLfloat scale;              // Current render scale per axis
+    GLint renderWidth;
+    GLint renderHeight;
+    GLfloat targetMs;
+    GLfloat lastGpuMs;          // Most recent GPU frame time read back
+    GLfloat smoothedGpuMs;      // Exponential moving average the controller acts on
+    GLuint adjustments;         // How often the scale changed
+};
+
+// Renders the scene into an offscreen target whose resolution follows the measured GPU frame time,
+// then upscales it to the window with a linear-filtered blit.
+// The target is allocated once at the maximum scale and only the viewport changes, so rescaling costs nothing.
+class DynamicResolution
+{
+    public:
+    DynamicResolution(GLint windowWidth, GLint windowHeight, GLfloat targetMs = 16.6f, GLfloat minScale = 0.5f, GLfloat maxScale = 1.0f)
+    : windowWidth(windowWidth), windowHeight(windowHeight), minScale(minScale), maxScale(maxScale), queryIndex(0), queriesIssued(0)
+    {
+        this->telemetry.scale = maxScale;
+        this->telemetry.targetMs = targetMs;
+        this->telemetry.lastGpuMs = 0.0f;
+        this->telemetry.smoothedGpuMs = 0.0f;
+        this->telemetry.adjustments = 0;
+        this->updateSize();
+
+        this->targetWidth = (GLint)ceil(windowWidth * maxScale);
+        this->targetHeight = (GLint)ceil(windowHeight * maxScale);
+        this->framebuffer = GLFramebuffer::Create();
+        gpuResources().Track(RESOURCE_FRAMEBUFFER, this->framebuffer.Get(), 0);
+        this->color = GLTexture::Create();
+        glBindTexture(GL_TEXTURE_2D, this->color.Get());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, this->targetWidth, this->targetHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        this->depth = GLRenderbuffer::Create();
+        glBindRenderbuffer(GL_RENDERBUFFER, this->depth.Get());
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, this->targetWidth, this->targetHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        gpuResources().Track(RESOURCE_TEXTURE, this->color.Get(), (size_t)this->targetWidth * this->targetHeight * 4);
+        gpuResources().Track(RESOURCE_RENDERBUFFER, this->depth.Get(), (size_t)this->targetWidth * this->targetHeight * 4);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer.Get());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->color.Get(), 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depth.Get());
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::DYNAMIC_RESOLUTION::FRAMEBUFFER_INCOMPLETE" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenQueries(QUERY_COUNT, this->queries);
+    }
+
+    ~DynamicResolution()
+    {
+        glDeleteQueries(QUERY_COUNT, this->queries);
+    }
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    // Reads back finished timings, adapts the scale and binds the offscreen target for the frame's scene rendering
+    void BeginFrame()
+    {
+        this->collectTimings();
+        glBeginQuery(GL_TIME_ELAPSED, this->queries[this->queryIndex]);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer.Get());
+        glViewport(0, 0, this->telemetry.renderWidth, this->telemetry.renderHeight);
+    }
+
+    // Upscales the rendered region to the window
+    void EndFrame()
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffer.Get());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, this->telemetry.renderWidth, this->telemetry.renderHeight, 0, 0, this->windowWidth, this->windowHeight,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, this->windowWidth, this->windowHeight);
+        glEndQuery(GL_TIME_ELAPSED);
+        this->queryIndex = (this->queryIndex + 1) % QUERY_COUNT;
+        this->queriesIssued++;
+    }
+
+    void SetTargetMs(GLfloat targetMs)
+    {
+        this->telemetry.targetMs = targetMs;
+    }
+
+    void SetScaleRange(GLfloat minScale, GLfloat maxScale)
+    {
+        this->minScale = minScale;
+        this->maxScale = min(maxScale, (GLfloat)this->targetWidth / this->windowWidth);
+        this->telemetry.scale = max(this->minScale, min(this->maxScale, this->telemetry.scale));
+        this->updateSize();
+    }
+
+    GLfloat GetScale() const
+    {
+        return this->telemetry.scale;
+    }
+
+    const ResolutionTelemetry& Telemetry() const
+    {
+        return this->telemetry;
+    }
+
+    private:
+    static const GLuint QUERY_COUNT = 4;    // Timings are read a few frames late so the CPU never waits on them
+
+    GLint windowWidth, windowHeight;
+    GLint targetWidth, targetHeight;
+    GLfloat minScale, maxScale;
+    GLFramebuffer framebuffer;
+    GLTexture color;
+    GLRenderbuffer depth;
+    GLuint queries[QUERY_COUNT];
+    GLuint queryIndex;
+    GLuint queriesIssued;
+    ResolutionTelemetry telemetry;
+
+    void updateSize()
+    {
+        this->telemetry.renderWidth = max(1, (GLint)(this->windowWidth * this->telemetry.scale));
+        this->telemetry.renderHeight = max(1, (GLint)(this->windowHeight * this->telemetry.scale));
+    }
+
+    // The query about to be reused is the oldest one; if it has finished, feed it to the controller
+    void collectTimings()
+    {
+        if(this->queriesIssued < QUERY_COUNT)
+            return;
+        GLuint query = this->queries[this->queryIndex];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            return;
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        this->control(elapsed / 1.0e6f);
+    }
+
+    // Fragment cost scales with pixel count, i.e. with scale squared, so the scale needed to hit the target is
+    // scale * sqrt(target / measured). Steps are damped and a dead band keeps the scale from oscillating.
+    void control(GLfloat gpuMs)
+    {
+        ResolutionTelemetry& t = this->telemetry;
+        t.lastGpuMs = gpuMs;
+        t.smoothedGpuMs = t.smoothedGpuMs == 0.0f ? gpuMs : t.smoothedGpuMs * 0.9f + gpuMs * 0.1f;
+        GLfloat ratio = t.targetMs / max(t.smoothedGpuMs, 0.01f);
+        if(ratio > 0.95f && ratio < 1.1f)
+            return;
+        GLfloat wanted = t.scale * sqrt(ratio);
+        GLfloat next = max(this->minScale, min(this->maxScale, t.scale + (wanted - t.scale) * 0.25f));
+        if(fabs(next - t.scale) < 0.01f)
+            return;
+        t.scale = next;
+        t.adjustments++;
+        this->updateSize();
+    }
+};
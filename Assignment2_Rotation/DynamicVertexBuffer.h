@@ -0,0 +1,169 @@
+#pragma once
+// Std. Includes
+#include <algorithm>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+
+#include "GLHandle.h"
+
+// Vertex data rewritten by the CPU every frame, streamed through one buffer split into frameCount regions.
+// Same scheme as UniformRingBuffer: each region is fenced after the draws that read it; with ARB_buffer_storage the
+// buffer stays persistently mapped, otherwise the region is mapped unsynchronized for writing and the whole buffer
+// is orphaned rather than stalling when the GPU is still reading the region.
+// The mapped pointer may be written from any thread between BeginFrame and Unmap.
+class DynamicVertexBuffer
+{
+    public:
+    DynamicVertexBuffer() : regionSize(0), frameCount(0), frame(0), mapped(nullptr), persistentBase(nullptr), persistent(false)
+    {
+        for(GLuint i = 0; i < MAX_FRAMES; i++)
+            this->fences[i] = 0;
+    }
+
+    ~DynamicVertexBuffer()
+    {
+        this->release();
+    }
+
+    DynamicVertexBuffer(const DynamicVertexBuffer&) = delete;
+    DynamicVertexBuffer& operator=(const DynamicVertexBuffer&) = delete;
+
+    // (Re)creates the buffer with frameCount regions of regionSize bytes
+    void Create(GLsizeiptr regionSize, GLuint frameCount = 3)
+    {
+        this->release();
+        // Regions start on 256 bytes so every vertex attribute offset stays well aligned
+        this->regionSize = (regionSize + 255) / 256 * 256;
+        this->frameCount = min(max(frameCount, 2u), (GLuint)MAX_FRAMES);
+        this->frame = 0;
+
+        this->buffer = GLBuffer::Create();
+        glBindBuffer(GL_ARRAY_BUFFER, this->buffer.Get());
+        GLsizeiptr size = this->regionSize * this->frameCount;
+        if(GLEW_ARB_buffer_storage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+            this->persistentBase = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+            this->persistent = this->persistentBase != nullptr;
+        }
+        else
+            glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        gpuResources().Track(RESOURCE_BUFFER, this->buffer.Get(), size);
+    }
+
+    // Moves to the next region and returns where its regionSize bytes are written
+    char* BeginFrame()
+    {
+        GLsync& fence = this->fences[this->frame % this->frameCount];
+        if(fence)
+        {
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            if(status == GL_TIMEOUT_EXPIRED && !this->persistent)
+            {
+                // Fresh storage from the driver instead of a wait; the older regions become unreachable
+                glBindBuffer(GL_ARRAY_BUFFER, this->buffer.Get());
+                glBufferData(GL_ARRAY_BUFFER, this->regionSize * this->frameCount, NULL, GL_STREAM_DRAW);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                this->deleteFences();
+            }
+            else
+            {
+                while(status == GL_TIMEOUT_EXPIRED)
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                glDeleteSync(fence);
+                fence = 0;
+            }
+        }
+        if(this->persistent)
+            return this->persistentBase + this->RegionOffset();
+        glBindBuffer(GL_ARRAY_BUFFER, this->buffer.Get());
+        this->mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, this->RegionOffset(), this->regionSize,
+                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return this->mapped;
+    }
+
+    // Makes the region's writes visible to the GPU. Call on the GL thread once the writers are done, before drawing.
+    void Unmap()
+    {
+        if(!this->mapped)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, this->buffer.Get());
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        this->mapped = nullptr;
+    }
+
+    // Fences the region after the frame's last draw that reads it
+    void EndFrame()
+    {
+        this->Unmap();
+        this->fences[this->frame % this->frameCount] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        this->frame++;
+    }
+
+    GLuint Buffer() const
+    {
+        return this->buffer.Get();
+    }
+
+    // Offset of the current region in the buffer
+    GLintptr RegionOffset() const
+    {
+        return (GLintptr)(this->frame % this->frameCount) * this->regionSize;
+    }
+
+    GLsizeiptr RegionSize() const
+    {
+        return this->regionSize;
+    }
+
+    size_t GpuBytes() const
+    {
+        return (size_t)this->regionSize * this->frameCount;
+    }
+
+    bool Persistent() const
+    {
+        return this->persistent;
+    }
+
+    private:
+    static const GLuint MAX_FRAMES = 4;
+
+    GLBuffer buffer;
+    GLsizeiptr regionSize;
+    GLuint frameCount;
+    GLuint frame;
+    char* mapped;
+    char* persistentBase;
+    bool persistent;
+    GLsync fences[MAX_FRAMES];
+
+    void deleteFences()
+    {
+        for(GLuint i = 0; i < MAX_FRAMES; i++)
+            if(this->fences[i])
+            {
+                glDeleteSync(this->fences[i]);
+                this->fences[i] = 0;
+            }
+    }
+
+    void release()
+    {
+        this->deleteFences();
+        if(this->buffer && (this->persistent || this->mapped))
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, this->buffer.Get());
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        this->buffer.Reset();
+        this->mapped = this->persistentBase = nullptr;
+        this->persistent = false;
+    }
+};
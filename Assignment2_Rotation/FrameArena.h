@@ -0,0 +1,126 @@
+#pragma once
+// Std. Includes
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <iostream>
+using namespace std;
+
+// Linear allocator for data that only lives until the end of the frame. Allocation is a pointer bump and
+// Reset() frees everything at once. Memory is grown in blocks that are kept, so once the arena has seen its
+// largest frame it no longer touches the heap.
+class FrameArena
+{
+    public:
+    explicit FrameArena(size_t blockSize = 256 * 1024) : blockSize(blockSize), current(0), offset(0), used(0), highWater(0)
+    {
+        this->addBlock(blockSize);
+    }
+
+    ~FrameArena()
+    {
+        for(size_t i = 0; i < this->blocks.size(); i++)
+            free(this->blocks[i].memory);
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(max_align_t))
+    {
+        for(;;)
+        {
+            Block& block = this->blocks[this->current];
+            size_t start = (this->offset + alignment - 1) & ~(alignment - 1);
+            if(start + size <= block.size)
+            {
+                this->offset = start + size;
+                this->used += size;
+                return block.memory + start;
+            }
+            // Move on to the next retained block, or grow if this frame needs more than ever before
+            if(this->current + 1 == this->blocks.size())
+                this->addBlock(max(this->blockSize, size + alignment));
+            this->current++;
+            this->offset = 0;
+        }
+    }
+
+    template <typename T>
+    T* Allocate(size_t count)
+    {
+        return (T*)this->Allocate(count * sizeof(T), alignof(T));
+    }
+
+    // Releases everything allocated since the last reset. Destructors are not run, so only use it for trivial types
+    // (or containers whose memory comes from the arena and are gone by then).
+    void Reset()
+    {
+        this->highWater = max(this->highWater, this->used);
+        this->current = 0;
+        this->offset = 0;
+        this->used = 0;
+    }
+
+    size_t BytesUsed() const { return this->used; }
+    size_t HighWater() const { return max(this->highWater, this->used); }
+
+    private:
+    struct Block {
+        char* memory;
+        size_t size;
+    };
+    vector<Block> blocks;
+    size_t blockSize;
+    size_t current;
+    size_t offset;
+    size_t used;
+    size_t highWater;
+
+    void addBlock(size_t size)
+    {
+        Block block = { (char*)malloc(size), size };
+        if(!block.memory)
+            throw bad_alloc();
+        this->blocks.push_back(block);
+    }
+};
+
+// The arena reset at the start of every frame
+inline FrameArena& frameArena()
+{
+    static FrameArena arena;
+    return arena;
+}
+
+// Standard allocator on top of a FrameArena, so std containers can hold per-frame data without touching the heap.
+// deallocate is a no-op: the memory comes back when the arena is reset.
+template <typename T>
+class ArenaAllocator
+{
+    public:
+    typedef T value_type;
+
+    ArenaAllocator(FrameArena& arena = frameArena()) noexcept : arena(&arena) { }
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) { }
+
+    T* allocate(size_t count)
+    {
+        return this->arena->template Allocate<T>(count);
+    }
+
+    void deallocate(T*, size_t) noexcept { }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return this->arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return this->arena != other.arena; }
+
+    FrameArena* arena;
+};
+
+template <typename T>
+using FrameVector = vector<T, ArenaAllocator<T>>;
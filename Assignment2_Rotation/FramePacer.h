@@ -0,0 +1,207 @@
+#pragma once
+// Std. Includes
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+
+// Measured pacing over the last FramePacer::HISTORY frames
+struct FramePacingStats {
+    GLfloat intervalMs;         // Mean time between presented frames
+    GLfloat jitterMs;           // Standard deviation of that interval
+    GLfloat maxIntervalMs;      // Longest interval, i.e. the worst hitch
+    GLfloat queueDepth;         // Mean number of frames still on the GPU when a new one started
+    GLuint maxQueueDepth;
+    GLfloat fenceWaitMs;        // Mean time per frame spent waiting for the GPU to catch up
+    GLfloat limiterWaitMs;      // Mean time per frame spent waiting for the target rate
+};
+
+// Bounds how far the CPU can run ahead of the GPU and optionally caps the frame rate.
+// Every presented frame gets a fence. BeginFrame waits for the oldest one while maxFramesInFlight are queued,
+// so input is sampled at most that many frames before it is seen. Fewer frames in flight means lower latency,
+// more means the GPU never starves when a frame's CPU work spikes.
+// Waits sleep while the deadline is far and spin for the last stretch, since sleeps overshoot by up to a millisecond.
+class FramePacer
+{
+    public:
+    typedef chrono::steady_clock Clock;
+    static const GLuint MAX_FRAMES_IN_FLIGHT = 4;
+    static const GLuint HISTORY = 120;
+
+    // targetHz of 0 leaves the rate to the GPU (and vsync, if on)
+    FramePacer(GLuint maxFramesInFlight = 2, GLfloat targetHz = 0.0f)
+    : queued(0), oldest(0), frames(0), spinMargin(chrono::microseconds(1500))
+    {
+        for(GLuint i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+            this->fences[i] = 0;
+        this->SetMaxFramesInFlight(maxFramesInFlight);
+        this->SetTargetRate(targetHz);
+        this->lastPresent = this->nextDeadline = Clock::now();
+    }
+
+    ~FramePacer()
+    {
+        for(GLuint i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+            if(this->fences[i])
+                glDeleteSync(this->fences[i]);
+    }
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    void SetMaxFramesInFlight(GLuint count)
+    {
+        this->maxFramesInFlight = max(1u, min(count, (GLuint)MAX_FRAMES_IN_FLIGHT));
+    }
+
+    GLuint MaxFramesInFlight() const
+    {
+        return this->maxFramesInFlight;
+    }
+
+    void SetTargetRate(GLfloat hz)
+    {
+        this->targetHz = hz > 0.0f ? hz : 0.0f;
+        this->interval = chrono::duration_cast<Clock::duration>(chrono::duration<double>(hz > 0.0f ? 1.0 / hz : 0.0));
+        this->nextDeadline = Clock::now() + this->interval;
+    }
+
+    GLfloat TargetRate() const
+    {
+        return this->targetHz;
+    }
+
+    // Call before sampling input: retires finished frames, waits until another one may be queued, then holds
+    // the frame back until the target rate allows it
+    void BeginFrame()
+    {
+        Clock::time_point start = Clock::now();
+        this->retire(0);
+        GLuint queueDepth = this->queued;
+        while(this->queued >= this->maxFramesInFlight)
+            this->waitOldest();
+        Clock::time_point fenced = Clock::now();
+
+        if(this->interval.count() > 0)
+        {
+            WaitUntil(this->nextDeadline, this->spinMargin);
+            // After a long frame start counting from now rather than racing to catch up
+            this->nextDeadline = max(this->nextDeadline + this->interval, Clock::now());
+        }
+        Clock::time_point end = Clock::now();
+
+        GLuint slot = this->frames % HISTORY;
+        this->depth[slot] = queueDepth;
+        this->fenceWait[slot] = chrono::duration<GLfloat, milli>(fenced - start).count();
+        this->limiterWait[slot] = chrono::duration<GLfloat, milli>(end - fenced).count();
+    }
+
+    // Call right after the buffer swap: fences the frame and records when it was presented
+    void EndFrame()
+    {
+        GLuint slot = (this->oldest + this->queued) % MAX_FRAMES_IN_FLIGHT;
+        this->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        this->queued++;
+
+        Clock::time_point now = Clock::now();
+        this->intervals[this->frames % HISTORY] = chrono::duration<GLfloat, milli>(now - this->lastPresent).count();
+        this->lastPresent = now;
+        this->frames++;
+    }
+
+    // Blocks until the GPU has finished every queued frame, e.g. before timing something in isolation
+    void Drain()
+    {
+        while(this->queued > 0)
+            this->waitOldest();
+    }
+
+    FramePacingStats Stats() const
+    {
+        FramePacingStats stats = { 0.0f, 0.0f, 0.0f, 0.0f, 0, 0.0f, 0.0f };
+        // The first interval runs from construction, leave it out
+        GLuint count = min(this->frames > 0 ? this->frames - 1 : 0, (GLuint)HISTORY);
+        if(count == 0)
+            return stats;
+        GLfloat sum = 0.0f, sumSquares = 0.0f, depthSum = 0.0f, fenceSum = 0.0f, limiterSum = 0.0f;
+        for(GLuint i = 0; i < count; i++)
+        {
+            GLuint slot = (this->frames - 1 - i) % HISTORY;
+            sum += this->intervals[slot];
+            sumSquares += this->intervals[slot] * this->intervals[slot];
+            stats.maxIntervalMs = max(stats.maxIntervalMs, this->intervals[slot]);
+            depthSum += this->depth[slot];
+            stats.maxQueueDepth = max(stats.maxQueueDepth, this->depth[slot]);
+            fenceSum += this->fenceWait[slot];
+            limiterSum += this->limiterWait[slot];
+        }
+        stats.intervalMs = sum / count;
+        stats.jitterMs = sqrt(max(0.0f, sumSquares / count - stats.intervalMs * stats.intervalMs));
+        stats.queueDepth = depthSum / count;
+        stats.fenceWaitMs = fenceSum / count;
+        stats.limiterWaitMs = limiterSum / count;
+        return stats;
+    }
+
+    // Sleeps until shortly before the deadline, then spins the rest of the way
+    static void WaitUntil(Clock::time_point deadline, Clock::duration spinMargin)
+    {
+        Clock::time_point now = Clock::now();
+        if(deadline - now > spinMargin)
+            this_thread::sleep_for(deadline - now - spinMargin);
+        while(Clock::now() < deadline)
+            this_thread::yield();
+    }
+
+    private:
+    GLsync fences[MAX_FRAMES_IN_FLIGHT];    // Ring of queued frames, oldest first
+    GLuint queued;
+    GLuint oldest;
+    GLuint maxFramesInFlight;
+    GLfloat targetHz;
+    Clock::duration interval;
+    Clock::time_point nextDeadline;
+    Clock::time_point lastPresent;
+    GLuint frames;
+    Clock::duration spinMargin;
+
+    GLfloat intervals[HISTORY];
+    GLuint depth[HISTORY];
+    GLfloat fenceWait[HISTORY];
+    GLfloat limiterWait[HISTORY];
+
+    // Drops the fences the GPU has passed, checking with the given timeout (nanoseconds) on the oldest
+    void retire(GLuint64 timeout)
+    {
+        while(this->queued > 0)
+        {
+            GLenum status = glClientWaitSync(this->fences[this->oldest], GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+            if(status == GL_TIMEOUT_EXPIRED)
+                return;
+            glDeleteSync(this->fences[this->oldest]);
+            this->fences[this->oldest] = 0;
+            this->oldest = (this->oldest + 1) % MAX_FRAMES_IN_FLIGHT;
+            this->queued--;
+            timeout = 0;
+        }
+    }
+
+    // Waits for the oldest queued frame: polls for a short while (GPU frames often finish within it),
+    // then hands the rest of the wait to the driver in short slices so the thread sleeps
+    void waitOldest()
+    {
+        GLuint queuedBefore = this->queued;
+        Clock::time_point spinEnd = Clock::now() + chrono::microseconds(200);
+        while(this->queued == queuedBefore && Clock::now() < spinEnd)
+        {
+            this->retire(0);
+            if(this->queued == queuedBefore)
+                this_thread::yield();
+        }
+        while(this->queued == queuedBefore)
+            this->retire(1000000);
+    }
+};
@@ -0,0 +1,111 @@
+#pragma once
+// Std. Includes
+#include <utility>
+// GL Includes
+#include <GL/glew.h>
+
+#include "GpuResources.h"
+
+// Owning wrapper around an OpenGL object name. Move-only: the object is deleted exactly once, by whoever holds it last.
+// Deletes go through gpuResources(), which holds them back until the GPU has finished the frames that may use the object.
+template <typename Traits>
+class GLHandle
+{
+    public:
+    GLHandle() : id(0) { }
+    explicit GLHandle(GLuint id) : id(id) { }
+    ~GLHandle()
+    {
+        this->Reset();
+    }
+
+    GLHandle(const GLHandle&) = delete;
+    GLHandle& operator=(const GLHandle&) = delete;
+
+    GLHandle(GLHandle&& other) noexcept : id(other.id)
+    {
+        other.id = 0;
+    }
+
+    GLHandle& operator=(GLHandle&& other) noexcept
+    {
+        if(this != &other)
+        {
+            this->Reset();
+            this->id = other.id;
+            other.id = 0;
+        }
+        return *this;
+    }
+
+    // Creates a new object and returns a handle owning it
+    static GLHandle Create()
+    {
+        return GLHandle(Traits::Create());
+    }
+
+    GLuint Get() const
+    {
+        return this->id;
+    }
+
+    // Gives up ownership without deleting the object
+    GLuint Release()
+    {
+        GLuint released = this->id;
+        this->id = 0;
+        return released;
+    }
+
+    void Reset(GLuint newId = 0)
+    {
+        if(this->id != 0)
+            Traits::Delete(this->id);
+        this->id = newId;
+    }
+
+    explicit operator bool() const
+    {
+        return this->id != 0;
+    }
+
+    private:
+    GLuint id;
+};
+
+struct GLBufferTraits {
+    static GLuint Create() { GLuint id; glGenBuffers(1, &id); return id; }
+    static void Delete(GLuint id) { gpuResources().Delete(RESOURCE_BUFFER, id); }
+};
+
+struct GLVertexArrayTraits {
+    static GLuint Create() { GLuint id; glGenVertexArrays(1, &id); return id; }
+    static void Delete(GLuint id) { gpuResources().Delete(RESOURCE_VERTEX_ARRAY, id); }
+};
+
+struct GLTextureTraits {
+    static GLuint Create() { GLuint id; glGenTextures(1, &id); return id; }
+    static void Delete(GLuint id) { gpuResources().Delete(RESOURCE_TEXTURE, id); }
+};
+
+struct GLProgramTraits {
+    static GLuint Create() { return glCreateProgram(); }
+    static void Delete(GLuint id) { gpuResources().Delete(RESOURCE_PROGRAM, id); }
+};
+
+struct GLRenderbufferTraits {
+    static GLuint Create() { GLuint id; glGenRenderbuffers(1, &id); return id; }
+    static void Delete(GLuint id) { gpuResources().Delete(RESOURCE_RENDERBUFFER, id); }
+};
+
+struct GLFramebufferTraits {
+    static GLuint Create() { GLuint id; glGenFramebuffers(1, &id); return id; }
+    static void Delete(GLuint id) { gpuResources().Delete(RESOURCE_FRAMEBUFFER, id); }
+};
+
+typedef GLHandle<GLBufferTraits> GLBuffer;
+typedef GLHandle<GLVertexArrayTraits> GLVertexArray;
+typedef GLHandle<GLTextureTraits> GLTexture;
+typedef GLHandle<GLProgramTraits> GLProgram;
+typedef GLHandle<GLRenderbufferTraits> GLRenderbuffer;
+typedef GLHandle<GLFramebufferTraits> GLFramebuffer;
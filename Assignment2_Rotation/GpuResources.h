@@ -0,0 +1,303 @@
+#pragma once
+// Std. Includes
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+
+enum Resource_Kind {
+    RESOURCE_BUFFER,
+    RESOURCE_VERTEX_ARRAY,
+    RESOURCE_TEXTURE,
+    RESOURCE_RENDERBUFFER,
+    RESOURCE_PROGRAM,
+    RESOURCE_FRAMEBUFFER,
+    RESOURCE_KIND_COUNT
+};
+
+// Live GPU memory per kind of object, as tracked by GpuResources
+struct GpuResourceReport {
+    size_t bytes[RESOURCE_KIND_COUNT];      // Resident bytes
+    size_t evictableBytes[RESOURCE_KIND_COUNT];     // Resident bytes that have evict/restore callbacks
+    GLuint count[RESOURCE_KIND_COUNT];
+    size_t residentBytes;
+    size_t evictedBytes;        // Bytes of evicted objects, restored on their next use
+    size_t budgetBytes;         // 0 when there's no budget
+    GLuint evictions;
+    GLuint restores;
+    GLuint pendingDeletes;      // Objects waiting for the GPU to finish with them
+
+    void Print(ostream& out) const
+    {
+        static const char* names[RESOURCE_KIND_COUNT] = { "buffers", "vertex arrays", "textures", "renderbuffers", "programs", "framebuffers" };
+        out << "VRAM " << fixed << setprecision(1) << this->residentBytes / 1048576.0 << " MB";
+        if(this->budgetBytes > 0)
+            out << " of " << this->budgetBytes / 1048576.0 << " MB budget";
+        out << ", evicted " << this->evictedBytes / 1048576.0 << " MB (" << this->evictions << " evictions, " << this->restores << " restores), "
+            << this->pendingDeletes << " deletes pending" << endl;
+        for(GLuint i = 0; i < RESOURCE_KIND_COUNT; i++)
+            out << "  " << setw(14) << left << names[i] << right << setw(5) << this->count[i] << "  " << this->bytes[i] / 1024 << " KB ("
+                << this->evictableBytes[i] / 1024 << " KB evictable)" << endl;
+    }
+};
+
+// Registry of every GL object the renderer creates, with its size, and the only place they're deleted.
+// Deletes are queued and only carried out once a fence shows the GPU has finished the frames that could still use
+// the object, so a model can be swapped out mid-frame. Objects with evict/restore callbacks (textures, and meshes
+// that keep a CPU copy) are released least recently used first while the resident total is over the budget, and
+// restored on their next use. Eviction only considers objects unused for EVICT_AFTER_FRAMES, longer than any frame
+// stays in flight. Restores happen synchronously on first use, so a budget that's too small shows up as hitches.
+// GL thread only.
+class GpuResources
+{
+    public:
+    static const GLuint EVICT_AFTER_FRAMES = 4;
+    static const GLuint MAX_BATCHES = 8;
+
+    GpuResources() : frame(0), budget(0), residentBytes(0), evictions(0), restores(0), oldest(0), queued(0)
+    {
+        for(GLuint i = 0; i < MAX_BATCHES; i++)
+            this->batches[i].fence = 0;
+    }
+
+    // Nothing is deleted here: the context is gone by the time statics are destroyed. Call Flush before that.
+    ~GpuResources() { }
+
+    GpuResources(const GpuResources&) = delete;
+    GpuResources& operator=(const GpuResources&) = delete;
+
+    // Records (or updates) the size of an object
+    void Track(Resource_Kind kind, GLuint id, size_t bytes)
+    {
+        if(id == 0)
+            return;
+        Entry& entry = this->entries[key(kind, id)];
+        if(entry.resident)
+            this->residentBytes = this->residentBytes - entry.bytes + bytes;
+        entry.bytes = bytes;
+        entry.lastUsed = this->frame;
+    }
+
+    // Lets the object be evicted when over budget: evict releases its memory but keeps the name, restore refills it.
+    // Callbacks must not refer to anything that moves, e.g. a Mesh in a vector; register again after a move.
+    void SetEvictable(Resource_Kind kind, GLuint id, function<void()> evict, function<void()> restore)
+    {
+        auto found = this->entries.find(key(kind, id));
+        if(found == this->entries.end())
+            return;
+        found->second.evict = std::move(evict);
+        found->second.restore = std::move(restore);
+    }
+
+    // Marks the object as used this frame, restoring it first if it was evicted
+    void Use(Resource_Kind kind, GLuint id)
+    {
+        auto found = this->entries.find(key(kind, id));
+        if(found == this->entries.end())
+            return;
+        Entry& entry = found->second;
+        entry.lastUsed = this->frame;
+        if(entry.resident)
+            return;
+        entry.restore();
+        entry.resident = true;
+        this->residentBytes += entry.bytes;
+        this->restores++;
+    }
+
+    // Stops tracking the object and deletes it once the frames submitted so far are done with it
+    void Delete(Resource_Kind kind, GLuint id)
+    {
+        if(id == 0)
+            return;
+        auto found = this->entries.find(key(kind, id));
+        if(found != this->entries.end())
+        {
+            if(found->second.resident)
+                this->residentBytes -= found->second.bytes;
+            this->entries.erase(found);
+        }
+        this->pending.push_back(PendingDelete{ kind, id });
+    }
+
+    // Budget for the resident bytes, 0 for none
+    void SetBudget(size_t bytes)
+    {
+        this->budget = bytes;
+    }
+
+    size_t Budget() const
+    {
+        return this->budget;
+    }
+
+    size_t ResidentBytes() const
+    {
+        return this->residentBytes;
+    }
+
+    // Call once per frame after the swap: fences the frame's deletes, carries out the ones the GPU is done with
+    // and evicts until the budget is met
+    void EndFrame()
+    {
+        if(!this->pending.empty())
+        {
+            if(this->queued == MAX_BATCHES)
+                this->retire(true);
+            Batch& batch = this->batches[(this->oldest + this->queued) % MAX_BATCHES];
+            batch.deletes.swap(this->pending);
+            batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            this->queued++;
+        }
+        this->retire(false);
+        this->frame++;
+        if(this->budget > 0 && this->residentBytes > this->budget)
+            this->evict();
+    }
+
+    // Waits for the GPU and deletes everything queued. Call before the context is destroyed.
+    void Flush()
+    {
+        glFinish();
+        while(this->queued > 0)
+            this->retire(true);
+        deleteObjects(this->pending);
+    }
+
+    GpuResourceReport Report() const
+    {
+        GpuResourceReport report;
+        for(GLuint i = 0; i < RESOURCE_KIND_COUNT; i++)
+        {
+            report.bytes[i] = 0;
+            report.evictableBytes[i] = 0;
+            report.count[i] = 0;
+        }
+        report.residentBytes = this->residentBytes;
+        report.evictedBytes = 0;
+        report.budgetBytes = this->budget;
+        report.evictions = this->evictions;
+        report.restores = this->restores;
+        report.pendingDeletes = (GLuint)this->pending.size();
+        for(GLuint i = 0; i < this->queued; i++)
+            report.pendingDeletes += (GLuint)this->batches[(this->oldest + i) % MAX_BATCHES].deletes.size();
+        for(const auto& item : this->entries)
+        {
+            GLuint kind = (GLuint)(item.first >> 32);
+            report.count[kind]++;
+            if(item.second.resident)
+            {
+                report.bytes[kind] += item.second.bytes;
+                if(item.second.evict)
+                    report.evictableBytes[kind] += item.second.bytes;
+            }
+            else
+                report.evictedBytes += item.second.bytes;
+        }
+        return report;
+    }
+
+    private:
+    struct Entry {
+        size_t bytes;
+        GLuint lastUsed;            // Frame of the last Use
+        bool resident;
+        function<void()> evict, restore;
+
+        Entry() : bytes(0), lastUsed(0), resident(true) { }
+    };
+
+    struct PendingDelete {
+        Resource_Kind kind;
+        GLuint id;
+    };
+
+    // Deletes submitted before one fence. The vectors are kept and reused, so steady state doesn't allocate.
+    struct Batch {
+        GLsync fence;
+        vector<PendingDelete> deletes;
+    };
+
+    unordered_map<GLuint64, Entry> entries;
+    GLuint frame;
+    size_t budget;
+    size_t residentBytes;
+    GLuint evictions;
+    GLuint restores;
+    vector<PendingDelete> pending;      // Deleted since the last EndFrame
+    Batch batches[MAX_BATCHES];         // Ring of fenced batches, oldest first
+    GLuint oldest;
+    GLuint queued;
+    vector<pair<GLuint, GLuint64>> candidates;  // (last use, key) of evictable objects, reused by evict
+
+    static GLuint64 key(Resource_Kind kind, GLuint id)
+    {
+        return ((GLuint64)kind << 32) | id;
+    }
+
+    // Carries out the batches whose fence has passed; with wait, waits for the oldest one at least
+    void retire(bool wait)
+    {
+        while(this->queued > 0)
+        {
+            Batch& batch = this->batches[this->oldest];
+            GLenum status = glClientWaitSync(batch.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            while(wait && status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(batch.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            if(status == GL_TIMEOUT_EXPIRED)
+                return;
+            glDeleteSync(batch.fence);
+            batch.fence = 0;
+            deleteObjects(batch.deletes);
+            this->oldest = (this->oldest + 1) % MAX_BATCHES;
+            this->queued--;
+            wait = false;
+        }
+    }
+
+    static void deleteObjects(vector<PendingDelete>& deletes)
+    {
+        for(const PendingDelete& d : deletes)
+            switch(d.kind)
+            {
+                case RESOURCE_BUFFER: glDeleteBuffers(1, &d.id); break;
+                case RESOURCE_VERTEX_ARRAY: glDeleteVertexArrays(1, &d.id); break;
+                case RESOURCE_TEXTURE: glDeleteTextures(1, &d.id); break;
+                case RESOURCE_RENDERBUFFER: glDeleteRenderbuffers(1, &d.id); break;
+                case RESOURCE_PROGRAM: glDeleteProgram(d.id); break;
+                case RESOURCE_FRAMEBUFFER: glDeleteFramebuffers(1, &d.id); break;
+                default: break;
+            }
+        deletes.clear();
+    }
+
+    // Evicts the least recently used idle objects until the resident total fits the budget
+    void evict()
+    {
+        this->candidates.clear();
+        for(const auto& item : this->entries)
+            if(item.second.resident && item.second.evict && this->frame - item.second.lastUsed >= EVICT_AFTER_FRAMES)
+                this->candidates.push_back(make_pair(item.second.lastUsed, item.first));
+        sort(this->candidates.begin(), this->candidates.end());
+        for(GLuint i = 0; i < this->candidates.size() && this->residentBytes > this->budget; i++)
+        {
+            Entry& entry = this->entries[this->candidates[i].second];
+            entry.evict();
+            entry.resident = false;
+            this->residentBytes -= entry.bytes;
+            this->evictions++;
+        }
+    }
+};
+
+// The registry shared by everything drawn on the main context
+inline GpuResources& gpuResources()
+{
+    static GpuResources resources;
+    return resources;
+}
@@ -0,0 +1,74 @@
+#pragma once
+// Std. Includes
+#include <algorithm>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+
+// Measures the GPU time of a section of the frame with a pair of timestamp queries. Timestamps (unlike
+// GL_TIME_ELAPSED) can be taken inside another timed section, such as DynamicResolution's whole-frame query.
+// Results are read a few frames late so the CPU never waits for them.
+class GpuTimer
+{
+    public:
+    GpuTimer() : index(0), issued(0), lastMs(0.0f), smoothedMs(0.0f)
+    {
+        glGenQueries(QUERY_COUNT * 2, this->queries);
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(QUERY_COUNT * 2, this->queries);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void Begin()
+    {
+        this->collect();
+        glQueryCounter(this->queries[this->index * 2], GL_TIMESTAMP);
+    }
+
+    void End()
+    {
+        glQueryCounter(this->queries[this->index * 2 + 1], GL_TIMESTAMP);
+        this->index = (this->index + 1) % QUERY_COUNT;
+        this->issued++;
+    }
+
+    // Most recent measurement and its exponential moving average, in milliseconds
+    GLfloat LastMs() const { return this->lastMs; }
+    GLfloat SmoothedMs() const { return this->smoothedMs; }
+
+    // Forgets the average, e.g. when the measured work changed
+    void ResetAverage()
+    {
+        this->smoothedMs = 0.0f;
+    }
+
+    private:
+    static const GLuint QUERY_COUNT = 4;
+
+    GLuint queries[QUERY_COUNT * 2];
+    GLuint index;
+    GLuint issued;
+    GLfloat lastMs;
+    GLfloat smoothedMs;
+
+    // Reads the pair about to be reused if the GPU has got past it
+    void collect()
+    {
+        if(this->issued < QUERY_COUNT)
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(this->queries[this->index * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            return;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(this->queries[this->index * 2], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(this->queries[this->index * 2 + 1], GL_QUERY_RESULT, &end);
+        this->lastMs = (end - begin) / 1.0e6f;
+        this->smoothedMs = this->smoothedMs == 0.0f ? this->lastMs : this->smoothedMs * 0.9f + this->lastMs * 0.1f;
+    }
+};
@@ -0,0 +1,232 @@
+#pragma once
+// Std. Includes
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+using namespace std;
+
+// Which thread a startup task may run on
+enum Init_Lane {
+    INIT_MAIN,      // The thread that owns (or will own) the GL context and the window
+    INIT_WORKER     // Any thread; CPU-only work such as parsing and decoding
+};
+
+// Runs the startup steps as a dependency graph. Worker tasks start on their own thread as soon as their
+// dependencies are done, while the main thread works through its ready tasks in the order they were added,
+// so decoding and importing overlap context creation and shader compilation.
+// Every task is timed and PrintTimeline shows the schedule along with its critical path.
+class InitScheduler
+{
+    public:
+    typedef chrono::steady_clock Clock;
+
+    // Times are reported relative to epoch, e.g. the start of main
+    explicit InitScheduler(Clock::time_point epoch = Clock::now()) : epoch(epoch), failed(false), lastMainTask(-1) { }
+
+    ~InitScheduler()
+    {
+        this->joinWorkers();
+    }
+
+    InitScheduler(const InitScheduler&) = delete;
+    InitScheduler& operator=(const InitScheduler&) = delete;
+
+    // Adds a task and returns its id for use as a dependency. A task returning false aborts the startup.
+    size_t Add(const string& name, Init_Lane lane, const vector<size_t>& dependencies, function<bool()> run)
+    {
+        Task task;
+        task.name = name;
+        task.lane = lane;
+        task.dependencies = dependencies;
+        task.run = std::move(run);
+        task.state = PENDING;
+        task.start = task.end = 0.0;
+        task.previousOnLane = -1;
+        this->tasks.push_back(std::move(task));
+        return this->tasks.size() - 1;
+    }
+
+    // Runs every task, returns false if one of them failed. Must be called on the main thread.
+    bool Run()
+    {
+        unique_lock<mutex> lock(this->mutex_);
+        for(;;)
+        {
+            if(!this->failed)
+                this->launchWorkers();
+            int task = this->failed ? -1 : this->nextMainTask();
+            if(task >= 0)
+            {
+                this->tasks[task].state = RUNNING;
+                lock.unlock();
+                this->execute(task);
+                lock.lock();
+                continue;
+            }
+            if(this->runningCount() == 0)
+                break;
+            this->changed.wait(lock);
+        }
+        lock.unlock();
+        this->joinWorkers();
+        if(this->failed)
+            return false;
+        for(size_t i = 0; i < this->tasks.size(); i++)
+            if(this->tasks[i].state != DONE)
+            {
+                cout << "ERROR::INIT::UNRESOLVED_DEPENDENCY " << this->tasks[i].name << endl;
+                return false;
+            }
+        return true;
+    }
+
+    // Milliseconds since the epoch
+    double ElapsedMs() const
+    {
+        return chrono::duration<double, milli>(Clock::now() - this->epoch).count();
+    }
+
+    // One row per task with a bar showing when it ran. Tasks on the critical path, the chain of tasks that
+    // each waited on the previous one (a dependency or the main thread being busy), are marked with '*'.
+    void PrintTimeline(ostream& out) const
+    {
+        double total = 0.0;
+        for(size_t i = 0; i < this->tasks.size(); i++)
+            total = max(total, this->tasks[i].end);
+        vector<bool> critical = this->criticalPath();
+        const int width = 50;
+        out << "STARTUP::TIMELINE (" << fixed << setprecision(1) << total << " ms)" << endl;
+        for(size_t i = 0; i < this->tasks.size(); i++)
+        {
+            const Task& task = this->tasks[i];
+            int from = total > 0.0 ? (int)(task.start / total * width) : 0;
+            int to = total > 0.0 ? max(from + 1, (int)(task.end / total * width)) : 1;
+            string bar(width, ' ');
+            fill(bar.begin() + from, bar.begin() + min(to, width), task.lane == INIT_MAIN ? '#' : '=');
+            out << (critical[i] ? " * " : "   ") << left << setw(20) << task.name << right << (task.lane == INIT_MAIN ? " main   " : " worker ")
+                << setw(8) << task.start << setw(8) << task.end << setw(8) << task.end - task.start << " |" << bar << "|" << endl;
+        }
+    }
+
+    private:
+    enum Task_State { PENDING, RUNNING, DONE };
+
+    struct Task {
+        string name;
+        Init_Lane lane;
+        vector<size_t> dependencies;
+        function<bool()> run;
+        Task_State state;
+        double start, end;      // ms since the epoch
+        int previousOnLane;     // Main thread task that ran right before this one
+    };
+
+    Clock::time_point epoch;
+    vector<Task> tasks;
+    vector<thread> workers;
+    mutex mutex_;
+    condition_variable changed;
+    bool failed;
+    int lastMainTask;
+
+    bool ready(const Task& task) const
+    {
+        if(task.state != PENDING)
+            return false;
+        for(size_t i = 0; i < task.dependencies.size(); i++)
+            if(this->tasks[task.dependencies[i]].state != DONE)
+                return false;
+        return true;
+    }
+
+    int nextMainTask() const
+    {
+        for(size_t i = 0; i < this->tasks.size(); i++)
+            if(this->tasks[i].lane == INIT_MAIN && this->ready(this->tasks[i]))
+                return (int)i;
+        return -1;
+    }
+
+    size_t runningCount() const
+    {
+        size_t count = 0;
+        for(size_t i = 0; i < this->tasks.size(); i++)
+            if(this->tasks[i].state == RUNNING)
+                count++;
+        return count;
+    }
+
+    // Called with the lock held
+    void launchWorkers()
+    {
+        for(size_t i = 0; i < this->tasks.size(); i++)
+            if(this->tasks[i].lane == INIT_WORKER && this->ready(this->tasks[i]))
+            {
+                this->tasks[i].state = RUNNING;
+                this->workers.push_back(thread(&InitScheduler::execute, this, i));
+            }
+    }
+
+    void execute(size_t index)
+    {
+        Task& task = this->tasks[index];
+        task.start = this->ElapsedMs();
+        bool ok = task.run();
+        task.end = this->ElapsedMs();
+        {
+            lock_guard<mutex> lock(this->mutex_);
+            if(task.lane == INIT_MAIN)
+            {
+                task.previousOnLane = this->lastMainTask;
+                this->lastMainTask = (int)index;
+            }
+            task.state = DONE;
+            if(!ok)
+            {
+                cout << "ERROR::INIT::TASK_FAILED " << task.name << endl;
+                this->failed = true;
+            }
+        }
+        this->changed.notify_all();
+    }
+
+    void joinWorkers()
+    {
+        for(size_t i = 0; i < this->workers.size(); i++)
+            if(this->workers[i].joinable())
+                this->workers[i].join();
+        this->workers.clear();
+    }
+
+    // Walks back from the task that finished last, each time to whatever it was waiting for: the dependency that
+    // finished last, or the previous main thread task if that one held it up longer
+    vector<bool> criticalPath() const
+    {
+        vector<bool> critical(this->tasks.size(), false);
+        int current = -1;
+        for(size_t i = 0; i < this->tasks.size(); i++)
+            if(this->tasks[i].state == DONE && (current < 0 || this->tasks[i].end > this->tasks[current].end))
+                current = (int)i;
+        while(current >= 0)
+        {
+            critical[current] = true;
+            const Task& task = this->tasks[current];
+            int blocker = task.lane == INIT_MAIN ? task.previousOnLane : -1;
+            for(size_t i = 0; i < task.dependencies.size(); i++)
+            {
+                int dependency = (int)task.dependencies[i];
+                if(blocker < 0 || this->tasks[dependency].end > this->tasks[blocker].end)
+                    blocker = dependency;
+            }
+            current = blocker;
+        }
+        return critical;
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+// Std. Includes
+#include <string>
+#include <cstddef>
+using namespace std;
+// POSIX Includes
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Read-only memory mapping of a whole file. Move-only, the mapping is released with the object.
+class MappedFile
+{
+    public:
+    MappedFile() : data(nullptr), size(0) { }
+
+    explicit MappedFile(const string& path) : data(nullptr), size(0)
+    {
+        this->Open(path);
+    }
+
+    ~MappedFile()
+    {
+        this->Close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept : data(other.data), size(other.size)
+    {
+        other.data = nullptr;
+        other.size = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if(this != &other)
+        {
+            this->Close();
+            this->data = other.data;
+            this->size = other.size;
+            other.data = nullptr;
+            other.size = 0;
+        }
+        return *this;
+    }
+
+    // Maps the file, returns false if it can't be opened. Empty files open successfully with Data() == nullptr.
+    bool Open(const string& path)
+    {
+        this->Close();
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0;
+        if(ok && info.st_size > 0)
+        {
+            void* mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping == MAP_FAILED)
+                ok = false;
+            else
+            {
+                this->data = (const char*)mapping;
+                this->size = (size_t)info.st_size;
+            }
+        }
+        close(fd);
+        return ok;
+    }
+
+    void Close()
+    {
+        if(this->data)
+            munmap((void*)this->data, this->size);
+        this->data = nullptr;
+        this->size = 0;
+    }
+
+    const char* Data() const
+    {
+        return this->data;
+    }
+
+    size_t Size() const
+    {
+        return this->size;
+    }
+
+    bool IsOpen() const
+    {
+        return this->data != nullptr;
+    }
+
+    private:
+    const char* data;
+    size_t size;
+};
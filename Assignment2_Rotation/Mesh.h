@@ -11,6 +11,9 @@ using namespace std;
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "Shader.h"
+#include "GLHandle.h"
+#include "Meshlets.h"
+#include "FrameArena.h"
 
 struct Vertex {
     // Position
@@ -31,59 +34,149 @@ struct Texture {
     aiString path;
 };
 
+// Axis aligned bounding box of the vertex positions (both corners at the origin for an empty mesh)
+inline void computeBounds(const vector<Vertex>& vertices, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+    if(vertices.empty())
+    {
+        boundsMin = boundsMax = glm::vec3(0.0f);
+        return;
+    }
+    boundsMin = boundsMax = vertices[0].Position;
+    for(size_t i = 1; i < vertices.size(); i++)
+    {
+        boundsMin = glm::min(boundsMin, vertices[i].Position);
+        boundsMax = glm::max(boundsMax, vertices[i].Position);
+    }
+}
+
+// Whether a mesh keeps its vertices and indices in system memory once they've been uploaded
+enum Geometry_Storage {
+    GPU_ONLY,       // CPU copies are freed after upload
+    GPU_AND_CPU     // CPU copies are kept, e.g. for picking, collision or re-uploading
+};
+
 class Mesh {
     public:
     /*  Mesh Data  */
-    vector<Vertex> vertices;
+    vector<Vertex> vertices;    // Empty after upload unless the mesh was created with GPU_AND_CPU
     vector<GLuint> indices;
     vector<Texture> textures;
-    GLuint VAO;
+    GLVertexArray VAO;
+    GLsizei vertexCount;
+    GLsizei indexCount;
+    glm::vec3 boundsMin, boundsMax; // Object space bounding box, kept when the geometry is released
+    MeshletSet meshlets;            // Clusters of the index buffer for back-facing cluster culling
+    bool dynamic;                   // Positions and normals come from a per-frame stream, see SetDynamicSource
     
     /*  Functions  */
-    // Constructor
-    Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures)
+    // Constructor, takes ownership of the data. Pass the vectors with std::move to avoid copying them.
+    Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures, Geometry_Storage storage = GPU_ONLY)
+    : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), dynamic(false)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertexCount = (GLsizei)this->vertices.size();
+        this->indexCount = (GLsizei)this->indices.size();
+        computeBounds(this->vertices, this->boundsMin, this->boundsMax);
+        // Back faces are drawn, so open surfaces are left whole: their clusters can be seen from behind
+        if(MeshletSet::IsClosed(this->vertices, this->indices))
+        {
+            MeshletSet::SortByFacing(this->vertices, this->indices);
+            this->meshlets.Build(this->vertices, this->indices);
+        }
         
         // Now that we have all the required data, set the vertex buffers and its attribute pointers.
         this->setupMesh();
+        this->setupSamplers();
+        if(storage == GPU_ONLY)
+        this->ReleaseCpuGeometry();
     }
     
-    // Render the mesh
-    void Draw(Shader shader)
+    // Meshes own their GL objects, so they can be moved but not copied
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+    
+    // Frees the system memory copy of the geometry. The GPU buffers are unaffected, but can't be evicted anymore.
+    void ReleaseCpuGeometry()
     {
-        // Bind appropriate textures
-        GLuint diffuseNr = 1;
-        GLuint specularNr = 1;
-        GLuint normalNr = 1;
-        GLuint heightNr = 1;
+        vector<Vertex>().swap(this->vertices);
+        vector<GLuint>().swap(this->indices);
+        gpuResources().SetEvictable(RESOURCE_BUFFER, this->VBO.Get(), nullptr, nullptr);
+        gpuResources().SetEvictable(RESOURCE_BUFFER, this->EBO.Get(), nullptr, nullptr);
+    }
+    
+    // Lets the GPU buffers be evicted when over the VRAM budget and re-uploaded from the CPU copy on the next Draw.
+    // Only for meshes that keep their geometry (GPU_AND_CPU). The callbacks point at this mesh, so call it again
+    // once the mesh has been moved to where it stays.
+    void SetEvictable()
+    {
+        if(this->vertices.empty())
+        return;
+        GLuint vbo = this->VBO.Get(), ebo = this->EBO.Get();
+        gpuResources().SetEvictable(RESOURCE_BUFFER, vbo, [vbo] { resizeBuffer(vbo, 0, NULL); },
+                                    [this, vbo] { resizeBuffer(vbo, this->vertices.size() * sizeof(Vertex), this->vertices.data()); });
+        gpuResources().SetEvictable(RESOURCE_BUFFER, ebo, [ebo] { resizeBuffer(ebo, 0, NULL); },
+                                    [this, ebo] { resizeBuffer(ebo, this->indices.size() * sizeof(GLuint), this->indices.data()); });
+    }
+    
+    // Bytes of geometry held in system memory
+    size_t CpuBytes() const
+    {
+        return this->vertices.capacity() * sizeof(Vertex) + this->indices.capacity() * sizeof(GLuint);
+    }
+    
+    // Bytes of the vertex and index buffers
+    size_t GpuBytes() const
+    {
+        return (size_t)this->vertexCount * sizeof(Vertex) + (size_t)this->indexCount * sizeof(GLuint);
+    }
+    
+    // Reads positions and normals from an interleaved (position, normal) float stream at offset in buffer instead of
+    // the static vertex buffer; the other attributes stay where they are. Meshlet cones don't hold for deformed
+    // geometry, so the mesh is drawn whole from then on.
+    void SetDynamicSource(GLuint buffer, GLintptr offset)
+    {
+        glBindVertexArray(this->VAO.Get());
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)offset);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)(offset + 3 * sizeof(GLfloat)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        this->dynamic = true;
+    }
+    
+    // Render the mesh. Given the viewer's position in the mesh's object space, meshlets facing away from it
+    // are skipped and the rest is drawn with one multi-draw; stats (if given) counts what was culled.
+    void Draw(const Shader& shader, const glm::vec3* viewer = nullptr, MeshletStats* stats = nullptr) const
+    {
+        // Keeps them off the eviction list, and brings them back if they were evicted
+        gpuResources().Use(RESOURCE_BUFFER, this->VBO.Get());
+        gpuResources().Use(RESOURCE_BUFFER, this->EBO.Get());
+        // Bind appropriate textures. Sampler names were worked out at construction, so nothing is allocated here.
         for(GLuint i = 0; i < this->textures.size(); i++)
         {
             glActiveTexture(GL_TEXTURE0 + i); // Active proper texture unit before binding
-            // Retrieve texture number (the N in diffuse_textureN)
-            stringstream ss;
-            string number;
-            string name = this->textures[i].type;
-            if(name == "texture_diffuse")
-            ss << diffuseNr++; // Transfer GLuint to stream
-            else if(name == "texture_specular")
-            ss << specularNr++; // Transfer GLuint to stream
-            else if(name == "texture_normal")
-            ss << normalNr++; // Transfer GLuint to stream
-            else if(name == "texture_height")
-            ss << heightNr++; // Transfer GLuint to stream
-            number = ss.str();
             // Now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
+            glUniform1i(glGetUniformLocation(shader.Program, this->samplerNames[i].c_str()), i);
             // And finally bind the texture
+            gpuResources().Use(RESOURCE_TEXTURE, this->textures[i].id);
             glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
         }
         
         // Draw mesh
-        glBindVertexArray(this->VAO);
-        glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(this->VAO.Get());
+        if(viewer && !this->dynamic && this->meshlets.Count() > 0)
+        {
+            MeshletStats local;
+            local.Reset();
+            // Per-draw ranges, from the frame arena
+            FrameVector<GLsizei> counts(this->meshlets.Count());
+            FrameVector<const void*> offsets(this->meshlets.Count());
+            GLuint ranges = this->meshlets.Cull(*viewer, counts.data(), offsets.data(), stats ? *stats : local);
+            if(ranges > 0)
+            glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), ranges);
+        }
+        else
+        glDrawElements(GL_TRIANGLES, this->indexCount, GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
         
         // Always good practice to set everything back to defaults once configured.
@@ -96,27 +189,28 @@ class Mesh {
     
     private:
     /*  Render data  */
-    GLuint VBO, EBO;
+    GLBuffer VBO, EBO;
+    vector<string> samplerNames;    // Shader sampler each texture binds to, e.g. texture_diffuse1
     
     /*  Functions    */
     // Initializes all the buffer objects/arrays
     void setupMesh()
     {
         // Create buffers/arrays
-        glGenVertexArrays(1, &this->VAO);
-        glGenBuffers(1, &this->VBO);
-        glGenBuffers(1, &this->EBO);
+        this->VAO = GLVertexArray::Create();
+        this->VBO = GLBuffer::Create();
+        this->EBO = GLBuffer::Create();
         
-        glBindVertexArray(this->VAO);
+        glBindVertexArray(this->VAO.Get());
         // Load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO.Get());
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), this->vertices.data(), GL_STATIC_DRAW);
         
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO.Get());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), this->indices.data(), GL_STATIC_DRAW);
         
         // Set the vertex attribute pointers
         // Vertex Positions
@@ -136,5 +230,40 @@ class Mesh {
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
         
         glBindVertexArray(0);
+        gpuResources().Track(RESOURCE_VERTEX_ARRAY, this->VAO.Get(), 0);
+        gpuResources().Track(RESOURCE_BUFFER, this->VBO.Get(), this->vertices.size() * sizeof(Vertex));
+        gpuResources().Track(RESOURCE_BUFFER, this->EBO.Get(), this->indices.size() * sizeof(GLuint));
+    }
+    
+    // Respecifies a buffer's storage without touching any vertex array's element buffer binding
+    static void resizeBuffer(GLuint buffer, size_t bytes, const void* data)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, data, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    
+    // Names the sampler of each texture: its type plus the N-th occurrence of that type (the N in diffuse_textureN)
+    void setupSamplers()
+    {
+        GLuint diffuseNr = 1;
+        GLuint specularNr = 1;
+        GLuint normalNr = 1;
+        GLuint heightNr = 1;
+        this->samplerNames.reserve(this->textures.size());
+        for(GLuint i = 0; i < this->textures.size(); i++)
+        {
+            const string& name = this->textures[i].type;
+            if(name == "texture_diffuse")
+            this->samplerNames.push_back(name + to_string(diffuseNr++));
+            else if(name == "texture_specular")
+            this->samplerNames.push_back(name + to_string(specularNr++));
+            else if(name == "texture_normal")
+            this->samplerNames.push_back(name + to_string(normalNr++));
+            else if(name == "texture_height")
+            this->samplerNames.push_back(name + to_string(heightNr++));
+            else
+            this->samplerNames.push_back(name);
+        }
     }
 };
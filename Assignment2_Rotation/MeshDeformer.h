@@ -0,0 +1,270 @@
+#pragma once
+// Std. Includes
+#include <vector>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+#include "Mesh.h"
+
+// Absolute positions and normals of one morph target, in the mesh's vertex order (how ASSIMP stores anim meshes)
+struct MorphShape {
+    vector<glm::vec3> positions;
+    vector<glm::vec3> normals;
+};
+
+// Procedural flex of a rotor blade: points are lifted along the axis by amplitude * sin(frequency * t) * r^2,
+// r being their distance from the axis through the hub, so blade tips bend most
+struct RotorFlex {
+    glm::vec3 hub;
+    glm::vec3 axis;             // Unit length
+    GLfloat amplitude;
+    GLfloat frequency;          // Radians per second
+};
+
+// Per-frame cost of the deformation and of streaming its results
+struct DeformStats {
+    GLuint vertices;
+    size_t bytes;               // Written to the dynamic vertex buffer
+    GLfloat deformMs;           // Wall time of the parallel deformation, including the writes into mapped memory
+    GLfloat streamMs;           // Mapping and unmapping the buffer region
+};
+
+// Deforms the positions and normals of one mesh on the CPU: weighted morph target deltas, then an optional rotor flex.
+// The rest pose and deltas are kept as separate x/y/z arrays (padded to a multiple of 4) so four vertices are
+// processed per SSE instruction; results are written interleaved (position, normal) for the dynamic vertex buffer.
+class MeshDeformer
+{
+    public:
+    static const GLuint OUTPUT_FLOATS = 6;  // Position and normal of each output vertex
+
+    GLuint mesh;                // Index of the deformed mesh in its model
+    vector<GLfloat> weights;    // One per morph target
+
+    MeshDeformer(const vector<Vertex>& vertices, GLuint mesh = 0) : mesh(mesh), hasFlex(false)
+    {
+        this->vertexCount = (GLuint)vertices.size();
+        this->rest.Resize(this->vertexCount);
+        for(GLuint i = 0; i < this->vertexCount; i++)
+            this->rest.Set(i, vertices[i].Position, vertices[i].Normal);
+    }
+
+    // Adds a target as the difference to the rest pose; missing normals leave the normals to the renormalization
+    void AddMorphTarget(const MorphShape& shape)
+    {
+        Channels deltas;
+        deltas.Resize(this->vertexCount);
+        for(GLuint i = 0; i < this->vertexCount && i < shape.positions.size(); i++)
+        {
+            glm::vec3 position(this->rest.x[i], this->rest.y[i], this->rest.z[i]);
+            glm::vec3 normal(this->rest.nx[i], this->rest.ny[i], this->rest.nz[i]);
+            deltas.Set(i, shape.positions[i] - position, i < shape.normals.size() ? shape.normals[i] - normal : glm::vec3(0.0f));
+        }
+        this->targets.push_back(std::move(deltas));
+        this->weights.push_back(0.0f);
+    }
+
+    void SetFlex(const RotorFlex& flex)
+    {
+        this->flex = flex;
+        this->hasFlex = true;
+    }
+
+    GLuint VertexCount() const
+    {
+        return this->vertexCount;
+    }
+
+    GLuint TargetCount() const
+    {
+        return (GLuint)this->targets.size();
+    }
+
+    // Bytes one deformed copy of the mesh takes in the vertex stream
+    size_t OutputBytes() const
+    {
+        return (size_t)this->vertexCount * OUTPUT_FLOATS * sizeof(GLfloat);
+    }
+
+    size_t CpuBytes() const
+    {
+        return (this->targets.size() + 1) * this->rest.x.capacity() * sizeof(GLfloat) * 6 + this->weights.capacity() * sizeof(GLfloat);
+    }
+
+    // Grows a rest pose bounding box to contain every pose, for morph weights within [0, 1]
+    void ExpandBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const
+    {
+        glm::vec3 grow(0.0f), shrink(0.0f);
+        for(const Channels& d : this->targets)
+        {
+            glm::vec3 low(0.0f), high(0.0f);
+            for(GLuint i = 0; i < this->vertexCount; i++)
+            {
+                low = glm::min(low, glm::vec3(d.x[i], d.y[i], d.z[i]));
+                high = glm::max(high, glm::vec3(d.x[i], d.y[i], d.z[i]));
+            }
+            shrink += low;
+            grow += high;
+        }
+        boundsMin += shrink;
+        boundsMax += grow;
+        if(this->hasFlex)
+        {
+            // The flex bends the morphed positions. With morph targets those can be anywhere in the grown box, and the
+            // distance from the axis is largest at one of its corners; without them the rest pose gives a tighter bound.
+            GLfloat radius2 = 0.0f;
+            for(GLuint i = 0; i < (this->targets.empty() ? this->vertexCount : 8); i++)
+            {
+                glm::vec3 p = this->targets.empty() ? glm::vec3(this->rest.x[i], this->rest.y[i], this->rest.z[i])
+                                                    : glm::vec3(i & 1 ? boundsMax.x : boundsMin.x, i & 2 ? boundsMax.y : boundsMin.y, i & 4 ? boundsMax.z : boundsMin.z);
+                glm::vec3 v = p - this->flex.hub;
+                glm::vec3 radial = v - glm::dot(v, this->flex.axis) * this->flex.axis;
+                radius2 = max(radius2, glm::dot(radial, radial));
+            }
+            glm::vec3 reach = glm::abs(this->flex.axis) * (fabs(this->flex.amplitude) * radius2);
+            boundsMin -= reach;
+            boundsMax += reach;
+        }
+    }
+
+    // Writes vertices [begin, end) to out, which holds the whole mesh (OUTPUT_FLOATS per vertex from vertex 0).
+    // begin has to be a multiple of 4. Chunks may run on different threads.
+    void Deform(GLfloat time, GLfloat* out, GLuint begin, GLuint end, bool simd = true) const
+    {
+        GLfloat bend = this->hasFlex ? this->flex.amplitude * sin(this->flex.frequency * time) : 0.0f;
+        GLuint i = begin;
+#if defined(__SSE2__)
+        if(simd)
+            for(; i + 4 <= end; i += 4)
+                this->deform4(i, bend, out + i * OUTPUT_FLOATS);
+#endif
+        for(; i < end; i++)
+            this->deform1(i, bend, out + i * OUTPUT_FLOATS);
+    }
+
+    private:
+    // Six float arrays, x/y/z of position and normal, with room for whole groups of 4
+    struct Channels {
+        vector<GLfloat> x, y, z, nx, ny, nz;
+
+        void Resize(GLuint count)
+        {
+            size_t padded = (count + 3) & ~3u;
+            for(vector<GLfloat>* v : { &this->x, &this->y, &this->z, &this->nx, &this->ny, &this->nz })
+                v->assign(padded, 0.0f);
+        }
+
+        void Set(GLuint i, const glm::vec3& position, const glm::vec3& normal)
+        {
+            this->x[i] = position.x;
+            this->y[i] = position.y;
+            this->z[i] = position.z;
+            this->nx[i] = normal.x;
+            this->ny[i] = normal.y;
+            this->nz[i] = normal.z;
+        }
+    };
+
+    GLuint vertexCount;
+    Channels rest;
+    vector<Channels> targets;
+    RotorFlex flex;
+    bool hasFlex;
+
+    void deform1(GLuint i, GLfloat bend, GLfloat* out) const
+    {
+        glm::vec3 p(this->rest.x[i], this->rest.y[i], this->rest.z[i]);
+        glm::vec3 n(this->rest.nx[i], this->rest.ny[i], this->rest.nz[i]);
+        for(GLuint t = 0; t < this->targets.size(); t++)
+        {
+            GLfloat w = this->weights[t];
+            if(w == 0.0f)
+                continue;
+            const Channels& d = this->targets[t];
+            p += w * glm::vec3(d.x[i], d.y[i], d.z[i]);
+            n += w * glm::vec3(d.nx[i], d.ny[i], d.nz[i]);
+        }
+        if(this->hasFlex)
+        {
+            // p' = p + axis * h(p) with h = bend * r^2; normals go through the inverse transpose of that map,
+            // n' = n - grad(h) * dot(axis, n), with grad(h) = 2 * bend * radial
+            glm::vec3 v = p - this->flex.hub;
+            glm::vec3 radial = v - glm::dot(v, this->flex.axis) * this->flex.axis;
+            p += this->flex.axis * (bend * glm::dot(radial, radial));
+            n -= radial * (2.0f * bend * glm::dot(this->flex.axis, n));
+        }
+        GLfloat length = glm::length(n);
+        n = length > 1e-12f ? n / length : n;
+        out[0] = p.x;
+        out[1] = p.y;
+        out[2] = p.z;
+        out[3] = n.x;
+        out[4] = n.y;
+        out[5] = n.z;
+    }
+
+#if defined(__SSE2__)
+    void deform4(GLuint i, GLfloat bend, GLfloat* out) const
+    {
+        __m128 x = _mm_loadu_ps(&this->rest.x[i]), y = _mm_loadu_ps(&this->rest.y[i]), z = _mm_loadu_ps(&this->rest.z[i]);
+        __m128 nx = _mm_loadu_ps(&this->rest.nx[i]), ny = _mm_loadu_ps(&this->rest.ny[i]), nz = _mm_loadu_ps(&this->rest.nz[i]);
+        for(GLuint t = 0; t < this->targets.size(); t++)
+        {
+            if(this->weights[t] == 0.0f)
+                continue;
+            __m128 w = _mm_set1_ps(this->weights[t]);
+            const Channels& d = this->targets[t];
+            x = _mm_add_ps(x, _mm_mul_ps(w, _mm_loadu_ps(&d.x[i])));
+            y = _mm_add_ps(y, _mm_mul_ps(w, _mm_loadu_ps(&d.y[i])));
+            z = _mm_add_ps(z, _mm_mul_ps(w, _mm_loadu_ps(&d.z[i])));
+            nx = _mm_add_ps(nx, _mm_mul_ps(w, _mm_loadu_ps(&d.nx[i])));
+            ny = _mm_add_ps(ny, _mm_mul_ps(w, _mm_loadu_ps(&d.ny[i])));
+            nz = _mm_add_ps(nz, _mm_mul_ps(w, _mm_loadu_ps(&d.nz[i])));
+        }
+        if(this->hasFlex)
+        {
+            __m128 ax = _mm_set1_ps(this->flex.axis.x), ay = _mm_set1_ps(this->flex.axis.y), az = _mm_set1_ps(this->flex.axis.z);
+            __m128 vx = _mm_sub_ps(x, _mm_set1_ps(this->flex.hub.x));
+            __m128 vy = _mm_sub_ps(y, _mm_set1_ps(this->flex.hub.y));
+            __m128 vz = _mm_sub_ps(z, _mm_set1_ps(this->flex.hub.z));
+            __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, ax), _mm_mul_ps(vy, ay)), _mm_mul_ps(vz, az));
+            __m128 rx = _mm_sub_ps(vx, _mm_mul_ps(along, ax));
+            __m128 ry = _mm_sub_ps(vy, _mm_mul_ps(along, ay));
+            __m128 rz = _mm_sub_ps(vz, _mm_mul_ps(along, az));
+            __m128 h = _mm_mul_ps(_mm_set1_ps(bend), _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_mul_ps(rz, rz)));
+            x = _mm_add_ps(x, _mm_mul_ps(ax, h));
+            y = _mm_add_ps(y, _mm_mul_ps(ay, h));
+            z = _mm_add_ps(z, _mm_mul_ps(az, h));
+            __m128 g = _mm_mul_ps(_mm_set1_ps(2.0f * bend), _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ax), _mm_mul_ps(ny, ay)), _mm_mul_ps(nz, az)));
+            nx = _mm_sub_ps(nx, _mm_mul_ps(rx, g));
+            ny = _mm_sub_ps(ny, _mm_mul_ps(ry, g));
+            nz = _mm_sub_ps(nz, _mm_mul_ps(rz, g));
+        }
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+        // Zero length normals (padding, degenerate input) are left as they are
+        __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(length, _mm_set1_ps(1e-12f)));
+        scale = _mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(length, _mm_set1_ps(1e-12f)), scale), _mm_andnot_ps(_mm_cmpgt_ps(length, _mm_set1_ps(1e-12f)), _mm_set1_ps(1.0f)));
+        nx = _mm_mul_ps(nx, scale);
+        ny = _mm_mul_ps(ny, scale);
+        nz = _mm_mul_ps(nz, scale);
+
+        // SoA to the interleaved layout: rows of (x y z nx) for each vertex, then its (ny nz) pair
+        _MM_TRANSPOSE4_PS(x, y, z, nx);
+        __m128 low = _mm_unpacklo_ps(ny, nz), high = _mm_unpackhi_ps(ny, nz);
+        _mm_storeu_ps(out, x);
+        _mm_storel_pi((__m64*)(out + 4), low);
+        _mm_storeu_ps(out + 6, y);
+        _mm_storeh_pi((__m64*)(out + 10), low);
+        _mm_storeu_ps(out + 12, z);
+        _mm_storel_pi((__m64*)(out + 16), high);
+        _mm_storeu_ps(out + 18, nx);
+        _mm_storeh_pi((__m64*)(out + 22), high);
+    }
+#endif
+};
@@ -0,0 +1,300 @@
+#pragma once
+// Std. Includes
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Per-draw counters of the meshlet culling
+struct MeshletStats {
+    GLuint meshlets;
+    GLuint culledMeshlets;
+    GLuint triangles;
+    GLuint culledTriangles;
+    GLuint draws;               // Ranges submitted after merging neighbouring survivors
+
+    void Reset()
+    {
+        this->meshlets = this->culledMeshlets = this->triangles = this->culledTriangles = this->draws = 0;
+    }
+
+    void Add(const MeshletStats& other)
+    {
+        this->meshlets += other.meshlets;
+        this->culledMeshlets += other.culledMeshlets;
+        this->triangles += other.triangles;
+        this->culledTriangles += other.culledTriangles;
+        this->draws += other.draws;
+    }
+};
+
+// Splits an index buffer into meshlets, small clusters of triangles with a bounding sphere and a cone
+// containing all their normals, so clusters facing away from the viewer can be skipped as a whole.
+// Meshlets are runs of consecutive triangles, so they keep using the mesh's index buffer as it is and a set of
+// surviving meshlets is drawn with one glMultiDrawElements call over the merged ranges.
+// Bounds and cones are stored as separate arrays (SoA) padded to a multiple of 4 for the SSE test.
+// The renderer doesn't cull back faces, so an open surface (a wing, a blade) shows its back side. Culling its clusters
+// would change the image, so only closed meshes get meshlets (see IsClosed); the back of those is never visible.
+class MeshletSet
+{
+    public:
+    static const GLuint MAX_VERTICES = 64;
+    static const GLuint MAX_TRIANGLES = 124;
+
+    vector<GLuint> first;       // First index of each meshlet
+    vector<GLuint> count;       // Index count of each meshlet
+    vector<GLfloat> centerX, centerY, centerZ, radius;
+    vector<GLfloat> axisX, axisY, axisZ, cutoff;
+
+    // Reorders the triangles so that ones facing the same way (by their normal's dominant axis) are adjacent,
+    // keeping their order within each of the six groups. Meshlets built afterwards get much narrower cones.
+    template <typename V>
+    static void SortByFacing(const vector<V>& vertices, vector<GLuint>& indices)
+    {
+        GLuint triangles = (GLuint)(indices.size() / 3);
+        vector<GLubyte> facing(triangles);
+        GLuint groupSize[7] = { 0 };
+        for(GLuint t = 0; t < triangles; t++)
+        {
+            const glm::vec3& a = vertices[indices[t * 3]].Position;
+            glm::vec3 n = glm::cross(vertices[indices[t * 3 + 1]].Position - a, vertices[indices[t * 3 + 2]].Position - a);
+            glm::vec3 m = glm::abs(n);
+            GLuint axis = m.x >= m.y && m.x >= m.z ? 0 : (m.y >= m.z ? 1 : 2);
+            facing[t] = (GLubyte)(axis * 2 + (n[axis] < 0.0f));
+            groupSize[facing[t] + 1]++;
+        }
+        for(GLuint g = 1; g < 7; g++)
+            groupSize[g] += groupSize[g - 1];
+        vector<GLuint> sorted(indices.size());
+        for(GLuint t = 0; t < triangles; t++)
+        {
+            GLuint slot = groupSize[facing[t]]++ * 3;
+            sorted[slot] = indices[t * 3];
+            sorted[slot + 1] = indices[t * 3 + 1];
+            sorted[slot + 2] = indices[t * 3 + 2];
+        }
+        // A trailing partial triangle (never drawn) stays where it was
+        copy(sorted.begin(), sorted.begin() + triangles * 3, indices.begin());
+    }
+
+    // True when the triangles form closed surfaces: every edge is shared with exactly one triangle that runs it the
+    // other way. Vertices are compared by position, as they're split along UV and normal seams.
+    template <typename V>
+    static bool IsClosed(const vector<V>& vertices, const vector<GLuint>& indices)
+    {
+        // Number the distinct positions
+        vector<GLuint> order(vertices.size());
+        for(GLuint i = 0; i < order.size(); i++)
+            order[i] = i;
+        auto less = [&vertices](GLuint a, GLuint b)
+        {
+            const glm::vec3& p = vertices[a].Position;
+            const glm::vec3& q = vertices[b].Position;
+            return p.x != q.x ? p.x < q.x : (p.y != q.y ? p.y < q.y : p.z < q.z);
+        };
+        sort(order.begin(), order.end(), less);
+        vector<GLuint> position(vertices.size());
+        for(GLuint i = 0, id = 0; i < order.size(); i++)
+        {
+            if(i > 0 && less(order[i - 1], order[i]))
+                id++;
+            position[order[i]] = id;
+        }
+        vector<uint64_t> edges;
+        edges.reserve(indices.size());
+        for(GLuint t = 0; t + 2 < indices.size(); t += 3)
+            for(GLuint k = 0; k < 3; k++)
+            {
+                GLuint a = position[indices[t + k]], b = position[indices[t + (k + 1) % 3]];
+                if(a != b)
+                    edges.push_back((uint64_t)a << 32 | b);
+            }
+        if(edges.empty())
+            return false;
+        sort(edges.begin(), edges.end());
+        for(size_t i = 0; i < edges.size(); i++)
+        {
+            uint64_t reverse = edges[i] << 32 | edges[i] >> 32;
+            if((i + 1 < edges.size() && edges[i + 1] == edges[i]) || !binary_search(edges.begin(), edges.end(), reverse))
+                return false;
+        }
+        return true;
+    }
+
+    // Builds the meshlets of an indexed triangle list. V only needs a glm::vec3 Position member.
+    template <typename V>
+    void Build(const vector<V>& vertices, const vector<GLuint>& indices, GLuint maxVertices = MAX_VERTICES, GLuint maxTriangles = MAX_TRIANGLES)
+    {
+        this->Clear();
+        maxTriangles = min(maxTriangles, (GLuint)MAX_TRIANGLES);
+        // stamp[v] == current meshlet + 1 when v is already counted in the meshlet being filled
+        vector<GLuint> stamp(vertices.size(), 0);
+        GLuint meshletVertices = 0, meshletTriangles = 0, begin = 0;
+        for(GLuint t = 0; t + 2 < indices.size(); t += 3)
+        {
+            GLuint mark = (GLuint)this->first.size() + 1;
+            GLuint added = (stamp[indices[t]] != mark) + (stamp[indices[t + 1]] != mark) + (stamp[indices[t + 2]] != mark);
+            if(meshletTriangles > 0 && (meshletVertices + added > maxVertices || meshletTriangles + 1 > maxTriangles))
+            {
+                this->addMeshlet(vertices, indices, begin, t);
+                begin = t;
+                meshletVertices = meshletTriangles = 0;
+                mark++;
+                added = 3 - (indices[t] == indices[t + 1]) - (indices[t + 1] == indices[t + 2] || indices[t] == indices[t + 2]);
+            }
+            stamp[indices[t]] = stamp[indices[t + 1]] = stamp[indices[t + 2]] = mark;
+            meshletVertices += added;
+            meshletTriangles++;
+        }
+        if(meshletTriangles > 0)
+            this->addMeshlet(vertices, indices, begin, (GLuint)(indices.size() / 3 * 3));
+        // Padding entries can never pass the test's index check, their values don't matter
+        size_t padded = (this->first.size() + 3) & ~(size_t)3;
+        for(vector<GLfloat>* v : { &this->centerX, &this->centerY, &this->centerZ, &this->radius, &this->axisX, &this->axisY, &this->axisZ, &this->cutoff })
+            v->resize(padded, 0.0f);
+    }
+
+    void Clear()
+    {
+        this->first.clear();
+        this->count.clear();
+        for(vector<GLfloat>* v : { &this->centerX, &this->centerY, &this->centerZ, &this->radius, &this->axisX, &this->axisY, &this->axisZ, &this->cutoff })
+            v->clear();
+    }
+
+    GLuint Count() const
+    {
+        return (GLuint)this->first.size();
+    }
+
+    size_t CpuBytes() const
+    {
+        return (this->first.capacity() + this->count.capacity()) * sizeof(GLuint) + this->centerX.capacity() * sizeof(GLfloat) * 8;
+    }
+
+    // Rejects the meshlets facing away from a viewer given in the mesh's object space, 4 at a time.
+    // The survivors' index ranges are written to counts/offsets (room for Count() entries), with neighbours merged
+    // into one range. Returns the number of ranges.
+    GLuint Cull(const glm::vec3& viewer, GLsizei* counts, const void** offsets, MeshletStats& stats) const
+    {
+        GLuint meshletCount = this->Count();
+        GLuint ranges = 0;
+        GLuint rangeEnd = ~0u;      // Index one past the last range, to merge a directly following meshlet into it
+        stats.meshlets += meshletCount;
+        for(GLuint base = 0; base < meshletCount; base += 4)
+        {
+            GLuint culled = this->cullMask(base, viewer);
+            for(GLuint i = base; i < min(base + 4, meshletCount); i++)
+            {
+                stats.triangles += this->count[i] / 3;
+                if(culled & (1u << (i - base)))
+                {
+                    stats.culledMeshlets++;
+                    stats.culledTriangles += this->count[i] / 3;
+                    continue;
+                }
+                if(this->first[i] == rangeEnd)
+                    counts[ranges - 1] += this->count[i];
+                else
+                {
+                    counts[ranges] = this->count[i];
+                    offsets[ranges] = (const void*)((size_t)this->first[i] * sizeof(GLuint));
+                    ranges++;
+                }
+                rangeEnd = this->first[i] + this->count[i];
+            }
+        }
+        stats.draws += ranges;
+        return ranges;
+    }
+
+    private:
+    // A meshlet is back facing as a whole when the viewer lies inside the cone opposite its normals, widened by the
+    // bounding sphere: dot(center - viewer, axis) >= cutoff * |center - viewer| + radius. Returns one bit per meshlet.
+    GLuint cullMask(GLuint base, const glm::vec3& viewer) const
+    {
+#if defined(__SSE2__)
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(&this->centerX[base]), _mm_set1_ps(viewer.x));
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(&this->centerY[base]), _mm_set1_ps(viewer.y));
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(&this->centerZ[base]), _mm_set1_ps(viewer.z));
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&this->axisX[base])), _mm_mul_ps(dy, _mm_loadu_ps(&this->axisY[base]))),
+                              _mm_mul_ps(dz, _mm_loadu_ps(&this->axisZ[base])));
+        __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        __m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&this->cutoff[base]), distance), _mm_loadu_ps(&this->radius[base]));
+        return (GLuint)_mm_movemask_ps(_mm_cmpge_ps(d, limit));
+#else
+        GLuint mask = 0;
+        for(GLuint i = 0; i < 4; i++)
+        {
+            GLfloat dx = this->centerX[base + i] - viewer.x, dy = this->centerY[base + i] - viewer.y, dz = this->centerZ[base + i] - viewer.z;
+            GLfloat d = dx * this->axisX[base + i] + dy * this->axisY[base + i] + dz * this->axisZ[base + i];
+            if(d >= this->cutoff[base + i] * sqrt(dx * dx + dy * dy + dz * dz) + this->radius[base + i])
+                mask |= 1u << i;
+        }
+        return mask;
+#endif
+    }
+
+    // Computes the bounds and normal cone of the triangles in indices [begin, end)
+    template <typename V>
+    void addMeshlet(const vector<V>& vertices, const vector<GLuint>& indices, GLuint begin, GLuint end)
+    {
+        this->first.push_back(begin);
+        this->count.push_back(end - begin);
+
+        glm::vec3 boundsMin = vertices[indices[begin]].Position, boundsMax = boundsMin;
+        for(GLuint i = begin; i < end; i++)
+        {
+            boundsMin = glm::min(boundsMin, vertices[indices[i]].Position);
+            boundsMax = glm::max(boundsMax, vertices[indices[i]].Position);
+        }
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        GLfloat radius = 0.0f;
+        for(GLuint i = begin; i < end; i++)
+            radius = max(radius, glm::length(vertices[indices[i]].Position - center));
+
+        // Cone axis is the average of the unit face normals, the cone has to reach the one furthest from it
+        glm::vec3 normals[MAX_TRIANGLES];
+        GLuint normalCount = 0;
+        glm::vec3 axis(0.0f);
+        for(GLuint i = begin; i < end && normalCount < MAX_TRIANGLES; i += 3)
+        {
+            const glm::vec3& a = vertices[indices[i]].Position;
+            glm::vec3 n = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+            GLfloat length = glm::length(n);
+            if(length <= 0.0f)
+                continue;
+            normals[normalCount++] = n / length;
+            axis += n / length;
+        }
+        GLfloat axisLength = glm::length(axis);
+        GLfloat minDot = 1.0f;
+        if(axisLength > 0.0f)
+        {
+            axis = axis / axisLength;
+            for(GLuint i = 0; i < normalCount; i++)
+                minDot = min(minDot, glm::dot(axis, normals[i]));
+        }
+        this->centerX.push_back(center.x);
+        this->centerY.push_back(center.y);
+        this->centerZ.push_back(center.z);
+        this->radius.push_back(radius);
+        // Normals spread over more than ~84 degrees from the axis leave no cone worth testing: a zero axis with cutoff 1 never culls
+        if(axisLength <= 0.0f || minDot <= 0.1f)
+        {
+            axis = glm::vec3(0.0f);
+            minDot = 0.0f;
+        }
+        this->axisX.push_back(axis.x);
+        this->axisY.push_back(axis.y);
+        this->axisZ.push_back(axis.z);
+        this->cutoff.push_back(sqrt(1.0f - minDot * minDot));
+    }
+};
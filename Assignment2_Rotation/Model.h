@@ -6,11 +6,16 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <memory>
+#include <cctype>
+#include <cstring>
+#include <chrono>
 using namespace std;
 // GL Includes
 #include <GL/glew.h> // Contains all the necessery OpenGL includes
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <SOIL/SOIL.h>
 
 #include <assimp/Importer.hpp>
@@ -18,126 +23,551 @@ using namespace std;
 #include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "SceneGraph.h"
+#include "Animation.h"
+#include "UniformBuffer.h"
+#include "ObjLoader.h"
+#include "FrameArena.h"
+#include "OcclusionCuller.h"
+#include "MeshDeformer.h"
+#include "DynamicVertexBuffer.h"
 
-GLint TextureFromFile(const char* path, string directory, bool gamma = false);
+// Decoded pixels waiting to be uploaded. Decoding doesn't need the GL context, so it can happen on any thread.
+struct TextureImage {
+    unsigned char* pixels;
+    int width, height;
+    
+    TextureImage() : pixels(nullptr), width(0), height(0) { }
+    TextureImage(TextureImage&& other) noexcept : pixels(other.pixels), width(other.width), height(other.height) { other.pixels = nullptr; }
+    TextureImage& operator=(TextureImage&& other) noexcept
+    {
+        swap(this->pixels, other.pixels);
+        this->width = other.width;
+        this->height = other.height;
+        return *this;
+    }
+    ~TextureImage()
+    {
+        if(this->pixels)
+        SOIL_free_image_data(this->pixels);
+    }
+};
+
+TextureImage decodeImage(const string& filename);
+GLuint uploadTexture(TextureImage& image, bool gamma = false, size_t* gpuBytes = nullptr, GLuint textureID = 0);
+GLint TextureFromFile(const char* path, string directory, bool gamma = false, size_t* gpuBytes = nullptr);
+void evictTexture(GLuint textureID);
+void setTextureEvictable(GLuint textureID, const string& filename, bool gamma);
+
+// Occluders are picked from the meshes with the largest bounds until their triangles fill this budget
+const GLuint OCCLUDER_TRIANGLE_BUDGET = 16384;
+
+// Vertices per deformation job, a multiple of 4 so jobs split on SIMD groups
+const GLuint DEFORM_GRAIN = 4096;
+
+// Wall time of the stages of Model::Import
+struct ImportTimings {
+    GLfloat parseMs;            // Reading the file into ASSIMP's scene (for the native OBJ importer: everything)
+    GLfloat convertMs;          // Walking the nodes and converting the meshes
+    GLfloat decodeMs;           // Decoding the textures
+};
+
+// Memory held by a model, split by where it lives
+struct ModelMemoryReport {
+    size_t cpuGeometryBytes;    // Vertices and indices kept in system memory
+    size_t cpuOtherBytes;       // Scene graph, animations, texture records
+    size_t gpuBufferBytes;      // Vertex and index buffers
+    size_t gpuTextureBytes;     // Textures including their mipmap chain (estimated from the uploaded size)
+    
+    size_t CpuBytes() const { return this->cpuGeometryBytes + this->cpuOtherBytes; }
+    size_t GpuBytes() const { return this->gpuBufferBytes + this->gpuTextureBytes; }
+    
+    void Print(ostream& out, const string& name) const
+    {
+        out << "MEMORY::MODEL " << name << endl
+            << "  CPU geometry: " << this->cpuGeometryBytes / 1024 << " KB, other: " << this->cpuOtherBytes / 1024 << " KB" << endl
+            << "  GPU buffers:  " << this->gpuBufferBytes / 1024 << " KB, textures: " << this->gpuTextureBytes / 1024 << " KB" << endl
+            << "  Total CPU " << this->CpuBytes() / 1024 << " KB, GPU " << this->GpuBytes() / 1024 << " KB" << endl;
+    }
+};
 
 class Model
 {
     public:
     /*  Model Data */
     vector<Texture> textures_loaded;	// Stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<GLTexture> textureObjects;   // Owns the GL textures referenced by textures_loaded
+    size_t textureBytes;
     vector<Mesh> meshes;
+    SceneGraph nodes;                   // ASSIMP's node hierarchy, tells which meshes are drawn with which transform
+    MeshletStats meshletStats;          // Meshlet culling of the last Draw
+    vector<MeshDeformer> deformers;     // Meshes with morph targets or rotor flex, deformed by Deform
+    DeformStats deformStats;            // Cost of the last Deform
+    ImportTimings importTimings;        // Where the last Import spent its time
+    bool nativeObj;                     // Read .obj files with the native importer rather than ASSIMP
+    vector<AnimationClip> animations;   // Node animations, their channels refer to indices in nodes
     string directory;
     bool gammaCorrection;
     
     /*  Functions   */
     // Constructor, expects a filepath to a 3D model.
-    Model(GLchar *path)
+    // With GPU_ONLY the meshes drop their vertex and index arrays once uploaded.
+    Model(const GLchar *path, Geometry_Storage storage = GPU_ONLY) : Model(storage)
     {
-        this->loadModel(path);
+        if(this->Import(path))
+        this->Upload();
     }
     
+    // Empty model, loaded in two steps: Import on any thread, then Upload on the thread owning the GL context
+    explicit Model(Geometry_Storage storage = GPU_ONLY) : textureBytes(0), nativeObj(true), gammaCorrection(false), storage(storage), cullPending(false), deformPending(false)
+    {
+        this->importTimings = ImportTimings{ 0.0f, 0.0f, 0.0f };
+        this->meshletStats.Reset();
+        this->deformStats = DeformStats{ 0, 0, 0.0f, 0.0f };
+    }
+    
+    // Models own GL objects through their meshes and textures, so they can be moved but not copied
+    Model(Model&&) = default;
+    Model& operator=(Model&&) = default;
+    
     // Draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    void Draw(const Shader& shader, UniformRingBuffer& frameUniforms)
+    {
+        this->Draw(shader, glm::mat4(), frameUniforms);
+    }
+    
+    // Draws all meshes with their node's transform applied on top of the given model matrix.
+    // All node matrices are streamed into the frame's uniform ring in one go, then each node binds its slice of it.
+    // The offsets only live for this call and come from the frame arena.
+    // With a viewer position (world space), meshlets facing away from it are culled; meshletStats counts them.
+    void Draw(const Shader& shader, const glm::mat4& modelMatrix, UniformRingBuffer& frameUniforms, const glm::vec3* viewer = nullptr)
+    {
+        this->meshletStats.Reset();
+        this->nodes.Update();
+        GLuint nodeCount = this->nodes.NodeCount();
+        FrameVector<GLintptr> objectOffsets(nodeCount);
+        for(GLuint i = 0; i < nodeCount; i++)
+        {
+            if(this->nodes.meshBegin[i] == this->nodes.meshBegin[i + 1])
+            continue;
+            ObjectBlock object;
+            object.model = modelMatrix * this->nodes.world[i];
+            objectOffsets[i] = frameUniforms.Push(&object, sizeof(ObjectBlock));
+        }
+        frameUniforms.Flush();
+        
+        for(GLuint i = 0; i < nodeCount; i++)
+        {
+            GLuint begin = this->nodes.meshBegin[i], end = this->nodes.meshBegin[i + 1];
+            if(begin == end || objectOffsets[i] < 0)
+            continue;
+            frameUniforms.Bind(UNIFORM_BINDING_OBJECT, objectOffsets[i], sizeof(ObjectBlock));
+            // Cone tests happen in the meshes' object space; assumes node transforms without non-uniform scale
+            glm::vec3 localViewer;
+            if(viewer)
+            localViewer = glm::vec3(glm::inverse(modelMatrix * this->nodes.world[i]) * glm::vec4(*viewer, 1.0f));
+            for(GLuint j = begin; j < end; j++)
+            {
+                if(this->cullPending && this->cullResults[j] != CULL_VISIBLE)
+                continue;
+                this->meshes[this->nodes.meshIndices[j]].Draw(shader, viewer ? &localViewer : nullptr, &this->meshletStats);
+            }
+        }
+        this->cullPending = false;
+        // The stream region is fenced once the last draw reading it has been submitted
+        if(this->deformPending)
+        this->deformStream->EndFrame();
+        this->deformPending = false;
+    }
+    
+    // Deforms the deformable meshes for time (seconds) on the pool, writing straight into the next region of the
+    // dynamic vertex buffer, and points the meshes at it for the next Draw
+    void Deform(GLfloat time, ThreadPool* pool = &workerPool())
+    {
+        if(this->deformers.empty())
+        return;
+        auto start = chrono::steady_clock::now();
+        this->deformTarget = this->deformStream->BeginFrame();
+        this->deformTime = time;
+        auto mapped = chrono::steady_clock::now();
+        // Only this is captured, so the std::function doesn't allocate
+        auto deform = [this](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; i++)
+            {
+                const DeformJob& job = this->deformJobs[i];
+                this->deformers[job.deformer].Deform(this->deformTime, (GLfloat*)(this->deformTarget + job.offset), job.begin, job.end);
+            }
+        };
+        if(pool)
+        pool->ParallelFor(this->deformJobs.size(), 1, deform);
+        else
+        deform(0, this->deformJobs.size());
+        auto deformed = chrono::steady_clock::now();
+        this->deformStream->Unmap();
+        for(GLuint i = 0; i < this->deformers.size(); i++)
+        this->meshes[this->deformers[i].mesh].SetDynamicSource(this->deformStream->Buffer(), this->deformStream->RegionOffset() + this->deformOffsets[i]);
+        this->deformPending = true;
+        
+        this->deformStats.deformMs = chrono::duration<GLfloat, milli>(deformed - mapped).count();
+        this->deformStats.streamMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - deformed + mapped - start).count();
+    }
+    
+    // Queues this model's occluder meshes, as placed by modelMatrix, into the culler's depth buffer
+    void SubmitOccluders(OcclusionCuller& culler, const glm::mat4& modelMatrix)
+    {
+        this->nodes.Update();
+        for(GLuint i = 0; i < this->nodes.NodeCount(); i++)
+        {
+            for(GLuint j = this->nodes.meshBegin[i]; j < this->nodes.meshBegin[i + 1]; j++)
+            {
+                GLint occluder = this->occluderOf[this->nodes.meshIndices[j]];
+                if(occluder < 0)
+                continue;
+                const Occluder& o = this->occluders[occluder];
+                culler.AddOccluder(modelMatrix * this->nodes.world[i], o.positions.data(), o.positions.size(), o.indices.data(), o.indices.size());
+            }
+        }
+    }
+    
+    // Tests the bounds of every mesh against the culler (after its occluders were rasterized), in parallel over the nodes.
+    // The next Draw skips the meshes found outside the frustum or occluded.
+    void Cull(OcclusionCuller& culler, const glm::mat4& modelMatrix, ThreadPool* pool = &workerPool())
+    {
+        auto start = chrono::steady_clock::now();
+        this->nodes.Update();
+        this->cullMatrix = modelMatrix;
+        this->cullResults.resize(this->nodes.meshIndices.size());
+        // Captures are kept to two pointers so the std::function doesn't allocate
+        OcclusionCuller* target = &culler;
+        auto test = [this, target](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; i++)
+            {
+                glm::mat4 model = this->cullMatrix * this->nodes.world[i];
+                for(GLuint j = this->nodes.meshBegin[i]; j < this->nodes.meshBegin[i + 1]; j++)
+                {
+                    const Mesh& mesh = this->meshes[this->nodes.meshIndices[j]];
+                    this->cullResults[j] = (GLubyte)target->TestBox(model, mesh.boundsMin, mesh.boundsMax);
+                }
+            }
+        };
+        if(pool)
+        pool->ParallelFor(this->nodes.NodeCount(), 8, test);
+        else
+        test(0, this->nodes.NodeCount());
+        for(GLuint j = 0; j < this->cullResults.size(); j++)
+        culler.Record((Cull_Result)this->cullResults[j], this->meshes[this->nodes.meshIndices[j]].indexCount / 3);
+        culler.AddTestTime(chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count());
+        this->cullPending = true;
+    }
+    
+    // Sums up the memory this model holds on the CPU and GPU side
+    ModelMemoryReport MemoryUsage() const
     {
+        ModelMemoryReport report = { 0, 0, 0, this->textureBytes };
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+        {
+            report.cpuGeometryBytes += this->meshes[i].CpuBytes();
+            report.cpuOtherBytes += this->meshes[i].textures.capacity() * sizeof(Texture) + this->meshes[i].meshlets.CpuBytes();
+            report.gpuBufferBytes += this->meshes[i].GpuBytes();
+        }
+        report.cpuOtherBytes += this->meshes.capacity() * sizeof(Mesh) + this->textures_loaded.capacity() * sizeof(Texture) + this->nodes.CpuBytes();
+        for(GLuint i = 0; i < this->occluders.size(); i++)
+        report.cpuOtherBytes += this->occluders[i].positions.capacity() * sizeof(glm::vec3) + this->occluders[i].indices.capacity() * sizeof(GLuint);
+        for(GLuint i = 0; i < this->animations.size(); i++)
+        report.cpuOtherBytes += this->animations[i].CpuBytes();
+        for(GLuint i = 0; i < this->deformers.size(); i++)
+        report.cpuGeometryBytes += this->deformers[i].CpuBytes();
+        if(this->deformStream)
+        report.gpuBufferBytes += this->deformStream->GpuBytes();
+        return report;
+    }
+    
+    // Reads the file, builds the scene graph and animations and decodes the textures (in parallel).
+    // Doesn't touch GL, so it can run on a worker thread while the context is being created.
+    // The meshes are converted and the textures decoded on pool.
+    bool Import(const string& path, ThreadPool* pool = &workerPool())
+    {
+        if(!this->loadModel(path, pool))
+        return false;
+        auto start = chrono::steady_clock::now();
+        auto decode = [this](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; i++)
+            this->pendingImages[i] = decodeImage(this->directory + '/' + this->textures_loaded[i].path.C_Str());
+        };
+        if(pool)
+        pool->ParallelFor(this->pendingImages.size(), 1, decode);
+        else
+        decode(0, this->pendingImages.size());
+        this->importTimings.decodeMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count();
+        return true;
+    }
+    
+    // Creates the GL textures and buffers for everything Import prepared. Needs the GL context.
+    void Upload()
+    {
+        // Textures first, the meshes' texture records still hold indices into textures_loaded
+        for(GLuint i = 0; i < this->pendingImages.size(); i++)
+        {
+            size_t bytes = 0;
+            this->textures_loaded[i].id = uploadTexture(this->pendingImages[i], this->gammaCorrection, &bytes);
+            this->textureObjects.push_back(GLTexture(this->textures_loaded[i].id));
+            setTextureEvictable(this->textures_loaded[i].id, this->directory + '/' + this->textures_loaded[i].path.C_Str(), this->gammaCorrection);
+            this->textureBytes += bytes;
+        }
+        vector<TextureImage>().swap(this->pendingImages);
+        
+        // Occluders and deformers copy their positions now, while every mesh still has its vertices.
+        // Deformed meshes aren't occluders, the culler would rasterize a pose they don't keep.
+        vector<bool> flexed = this->findFlexedMeshes();
+        this->selectOccluders(flexed);
+        GLuint firstDeformer = (GLuint)this->deformers.size();
+        this->setupDeformers(flexed);
+        this->meshes.reserve(this->meshes.size() + this->pendingMeshes.size());
+        for(GLuint i = 0; i < this->pendingMeshes.size(); i++)
+        {
+            PendingMesh& mesh = this->pendingMeshes[i];
+            for(GLuint j = 0; j < mesh.textures.size(); j++)
+            mesh.textures[j].id = this->textures_loaded[mesh.textures[j].id].id;
+            this->meshes.push_back(Mesh(std::move(mesh.vertices), std::move(mesh.indices), std::move(mesh.textures), this->storage));
+        }
+        vector<PendingMesh>().swap(this->pendingMeshes);
+        // Every mesh is where it stays now (a move of the model keeps the vector's storage)
         for(GLuint i = 0; i < this->meshes.size(); i++)
-        this->meshes[i].Draw(shader);
+        this->meshes[i].SetEvictable();
+        // Culling has to see every pose a deformed mesh can take
+        for(GLuint i = firstDeformer; i < this->deformers.size(); i++)
+        this->deformers[i].ExpandBounds(this->meshes[this->deformers[i].mesh].boundsMin, this->meshes[this->deformers[i].mesh].boundsMax);
     }
     
     private:
+    // Mesh data imported but not uploaded yet
+    struct PendingMesh {
+        vector<Vertex> vertices;
+        vector<GLuint> indices;
+        vector<Texture> textures;   // id is an index into textures_loaded until Upload
+        vector<MorphShape> morphShapes;
+    };
+    
+    // A run of one deformer's vertices, the unit of work handed to the pool
+    struct DeformJob {
+        GLuint deformer;
+        GLuint begin, end;
+        size_t offset;              // Byte offset of the deformer's output in the stream region
+    };
+    
+    // Position-only copy of a mesh used to occlude others on the CPU
+    struct Occluder {
+        vector<glm::vec3> positions;
+        vector<GLuint> indices;
+    };
+    
+    Geometry_Storage storage;
+    vector<PendingMesh> pendingMeshes;
+    vector<TextureImage> pendingImages; // Pixels for textures_loaded, same order
+    vector<Occluder> occluders;
+    vector<GLint> occluderOf;           // Index into occluders for each mesh, -1 if it isn't one
+    vector<GLubyte> cullResults;        // Cull_Result of each entry of nodes.meshIndices
+    glm::mat4 cullMatrix;
+    bool cullPending;                   // cullResults apply to the next Draw
+    unique_ptr<DynamicVertexBuffer> deformStream;   // Per-frame positions and normals of all deformers
+    vector<size_t> deformOffsets;       // Byte offset of each deformer's output in a stream region
+    vector<DeformJob> deformJobs;
+    GLfloat deformTime;
+    char* deformTarget;                 // Mapped stream region during Deform
+    bool deformPending;                 // The stream region is read by the next Draw and fenced after it
+    
     /*  Functions   */
-    // Loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string path)
+    // Marks the pending meshes whose node is named like a rotor part (rotor, blade, prop), which get a rotor flex
+    vector<bool> findFlexedMeshes() const
     {
-        // Read file via ASSIMP
+        GLuint first = (GLuint)this->meshes.size();
+        vector<bool> flexed(this->pendingMeshes.size(), false);
+        for(GLuint n = 0; n < this->nodes.NodeCount(); n++)
+        {
+            string name = this->nodes.names[n];
+            transform(name.begin(), name.end(), name.begin(), ::tolower);
+            if(name.find("rotor") == string::npos && name.find("blade") == string::npos && name.find("prop") == string::npos)
+            continue;
+            for(GLuint j = this->nodes.meshBegin[n]; j < this->nodes.meshBegin[n + 1]; j++)
+            if(this->nodes.meshIndices[j] >= first)
+            flexed[this->nodes.meshIndices[j] - first] = true;
+        }
+        return flexed;
+    }
+    
+    // Creates a deformer for each pending mesh with morph targets or flexed as a rotor part, sizes the vertex
+    // stream for all of them and splits their work into jobs
+    void setupDeformers(const vector<bool>& flexed)
+    {
+        GLuint first = (GLuint)this->meshes.size();
+        for(GLuint i = 0; i < this->pendingMeshes.size(); i++)
+        {
+            PendingMesh& pending = this->pendingMeshes[i];
+            if(pending.morphShapes.empty() && !flexed[i])
+            continue;
+            MeshDeformer deformer(pending.vertices, first + i);
+            for(GLuint t = 0; t < pending.morphShapes.size(); t++)
+            deformer.AddMorphTarget(pending.morphShapes[t]);
+            vector<MorphShape>().swap(pending.morphShapes);
+            if(flexed[i])
+            {
+                // Rotors are assumed to spin about their local y axis; tips bend by up to 5% of the rotor radius
+                glm::vec3 boundsMin, boundsMax;
+                computeBounds(pending.vertices, boundsMin, boundsMax);
+                GLfloat radius = max(max(boundsMax.x - boundsMin.x, boundsMax.z - boundsMin.z) * 0.5f, 1e-4f);
+                deformer.SetFlex(RotorFlex{ (boundsMin + boundsMax) * 0.5f, glm::vec3(0.0f, 1.0f, 0.0f), 0.05f / radius, 6.0f });
+            }
+            this->deformers.push_back(std::move(deformer));
+        }
+        if(this->deformers.empty())
+        return;
+        
+        size_t regionSize = 0;
+        this->deformOffsets.clear();
+        this->deformJobs.clear();
+        for(GLuint d = 0; d < this->deformers.size(); d++)
+        {
+            this->deformOffsets.push_back(regionSize);
+            for(GLuint v = 0; v < this->deformers[d].VertexCount(); v += DEFORM_GRAIN)
+            this->deformJobs.push_back(DeformJob{ d, v, min(v + DEFORM_GRAIN, this->deformers[d].VertexCount()), regionSize });
+            regionSize += (this->deformers[d].OutputBytes() + 15) & ~(size_t)15;
+        }
+        this->deformStream.reset(new DynamicVertexBuffer());
+        this->deformStream->Create(regionSize, 3);
+        this->deformStats.vertices = 0;
+        for(GLuint d = 0; d < this->deformers.size(); d++)
+        this->deformStats.vertices += this->deformers[d].VertexCount();
+        this->deformStats.bytes = regionSize;
+    }
+    
+    // Picks the pending meshes with the largest bounding boxes as occluders, as long as they fit in the triangle budget.
+    // Meshes that will be deformed (morph targets or flexed) are left out, only the rest pose could be rasterized.
+    void selectOccluders(const vector<bool>& flexed)
+    {
+        GLuint first = (GLuint)this->meshes.size();
+        this->occluderOf.resize(first + this->pendingMeshes.size(), -1);
+        vector<pair<GLfloat, GLuint> > candidates;
+        for(GLuint i = 0; i < this->pendingMeshes.size(); i++)
+        {
+            if(flexed[i] || !this->pendingMeshes[i].morphShapes.empty())
+            continue;
+            glm::vec3 boundsMin, boundsMax;
+            computeBounds(this->pendingMeshes[i].vertices, boundsMin, boundsMax);
+            glm::vec3 size = boundsMax - boundsMin;
+            candidates.push_back(make_pair(size.x * size.y + size.y * size.z + size.z * size.x, i));
+        }
+        sort(candidates.begin(), candidates.end(), greater<pair<GLfloat, GLuint> >());
+        GLuint budget = OCCLUDER_TRIANGLE_BUDGET;
+        for(GLuint c = 0; c < candidates.size(); c++)
+        {
+            PendingMesh& mesh = this->pendingMeshes[candidates[c].second];
+            GLuint triangles = (GLuint)mesh.indices.size() / 3;
+            if(triangles == 0 || triangles > budget)
+            continue;
+            budget -= triangles;
+            Occluder occluder;
+            occluder.positions.reserve(mesh.vertices.size());
+            for(GLuint v = 0; v < mesh.vertices.size(); v++)
+            occluder.positions.push_back(mesh.vertices[v].Position);
+            occluder.indices = mesh.indices;
+            this->occluderOf[first + candidates[c].second] = (GLint)this->occluders.size();
+            this->occluders.push_back(std::move(occluder));
+        }
+    }
+    
+    // Loads a model with supported ASSIMP extensions from file and stores the resulting meshes in pendingMeshes.
+    bool loadModel(const string& path, ThreadPool* pool)
+    {
+        auto start = chrono::steady_clock::now();
+        this->importTimings = ImportTimings{ 0.0f, 0.0f, 0.0f };
+        // Retrieve the directory path of the filepath
+        this->directory = path.substr(0, path.find_last_of('/'));
+        
+        // Wavefront OBJ files take the native multithreaded importer, ASSIMP remains the fallback for everything else
+        if(this->nativeObj && path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0)
+        {
+            ObjScene obj;
+            if(loadObj(path, obj, pool))
+            {
+                this->processObj(obj);
+                this->importTimings.parseMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count();
+                return true;
+            }
+        }
+        
+        // Read file via ASSIMP. Packed files are handed over from memory; formats that reference other files
+        // (other than the textures, which we load ourselves) need to stay loose.
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const GLuint flags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+        const char* packed;
+        size_t packedSize;
+        const aiScene* scene;
+        if(assetArchive().Lookup(path, packed, packedSize))
+        scene = importer.ReadFileFromMemory(packed, packedSize, flags, path.substr(path.find_last_of('.') + 1).c_str());
+        else
+        scene = importer.ReadFile(path, flags);
         // Check for errors
         if(!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // Retrieve the directory path of the filepath
-        this->directory = path.substr(0, path.find_last_of('/'));
         
-        // Process ASSIMP's root node recursively
-        this->processNode(scene->mRootNode, scene);
+        auto parsed = chrono::steady_clock::now();
+        this->importTimings.parseMs = chrono::duration<GLfloat, milli>(parsed - start).count();
+        
+        // Process ASSIMP's root node recursively, then convert the meshes it queued all at once
+        vector<const aiMesh*> sources;
+        this->processNode(scene->mRootNode, scene, -1, sources);
+        size_t first = this->pendingMeshes.size() - sources.size();
+        auto convert = [this, &sources, first](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; i++)
+            convertMesh(sources[i], this->pendingMeshes[first + i]);
+        };
+        if(pool)
+        pool->ParallelFor(sources.size(), 1, convert);
+        else
+        convert(0, sources.size());
+        this->importTimings.convertMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - parsed).count();
+        
+        // Import the node animations now that every node has an index to bind the channels to
+        for(GLuint i = 0; i < scene->mNumAnimations; i++)
+        this->animations.push_back(importAnimation(scene->mAnimations[i], this->nodes, true));
+        return true;
     }
     
     // Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // The node and its transformation are recorded in the scene graph so parts keep their placement and can be moved individually.
+    // Meshes are only queued here (in sources), see processMesh.
+    void processNode(aiNode* node, const aiScene* scene, GLint parentIndex, vector<const aiMesh*>& sources)
     {
+        GLuint nodeIndex = this->nodes.AddNode(parentIndex, node->mName.C_Str(), toGlm(node->mTransformation));
         // Process each mesh located at the current node
         for(GLuint i = 0; i < node->mNumMeshes; i++)
         {
             // The node object only contains indices to index the actual objects in the scene.
             // The scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            this->meshes.push_back(this->processMesh(mesh, scene));
+            this->nodes.AddMesh((GLuint)(this->meshes.size() + this->pendingMeshes.size()));
+            this->processMesh(mesh, scene, sources);
         }
         // After we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(GLuint i = 0; i < node->mNumChildren; i++)
         {
-            this->processNode(node->mChildren[i], scene);
+            this->processNode(node->mChildren[i], scene, nodeIndex, sources);
         }
         
     }
     
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // Registers the mesh's textures and reserves its pending slot. The geometry is filled in later by convertMesh,
+    // in parallel with the other meshes, since only the texture registry is shared between them.
+    void processMesh(aiMesh* mesh, const aiScene* scene, vector<const aiMesh*>& sources)
     {
-        // Data to fill
-        vector<Vertex> vertices;
-        vector<GLuint> indices;
-        vector<Texture> textures;
-        
-        // Walk through each of the mesh's vertices
-        for(GLuint i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // We declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // Positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // Normals
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
-            // Texture Coordinates
-            if(mesh->mTextureCoords[0]) // Does the mesh contain texture coordinates?
-            {
-                glm::vec2 vec;
-                // A vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-            }
-            else
-            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            // Tangent
-            vector.x = mesh->mTangents[i].x;
-            vector.y = mesh->mTangents[i].y;
-            vector.z = mesh->mTangents[i].z;
-            vertex.Tangent = vector;
-            // Bitangent
-            vector.x = mesh->mBitangents[i].x;
-            vector.y = mesh->mBitangents[i].y;
-            vector.z = mesh->mBitangents[i].z;
-            vertex.Bitangent = vector;
-            vertices.push_back(vertex);
-        }
-        // Now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for(GLuint i = 0; i < mesh->mNumFaces; i++)
-        {
-            aiFace face = mesh->mFaces[i];
-            // Retrieve all indices of the face and store them in the indices vector
-            for(GLuint j = 0; j < face.mNumIndices; j++)
-            indices.push_back(face.mIndices[j]);
-        }
+        PendingMesh pending;
         // Process materials
         if(mesh->mMaterialIndex >= 0)
         {
@@ -150,73 +580,218 @@ class Model
             // Normal: texture_normalN
             
             // 1. Diffuse maps
-            vector<Texture> diffuseMaps = this->loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-            textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+            this->loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", pending.textures);
             // 2. Specular maps
-            vector<Texture> specularMaps = this->loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-            textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+            this->loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", pending.textures);
             // 3. Normal maps
-            std::vector<Texture> normalMaps = this->loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-            textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+            this->loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", pending.textures);
             // 4. Height maps
-            std::vector<Texture> heightMaps = this->loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-            textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+            this->loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", pending.textures);
         }
+        this->pendingMeshes.push_back(std::move(pending));
+        sources.push_back(mesh);
+    }
+    
+    // Converts an ASSIMP mesh's vertex streams and faces into a pending mesh. Safe to run for several meshes at once.
+    // Arrays are sized exactly up front and every vertex is written in a single pass; streams the file didn't
+    // provide are derived: normals from the faces, tangents and bitangents as any basis around the normal.
+    static void convertMesh(const aiMesh* mesh, PendingMesh& pending)
+    {
+        GLuint vertexCount = mesh->mNumVertices;
+        size_t indexCount = 0;
+        for(GLuint i = 0; i < mesh->mNumFaces; i++)
+        indexCount += mesh->mFaces[i].mNumIndices;
         
-        // Return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        vector<Vertex>& vertices = pending.vertices;
+        vector<GLuint>& indices = pending.indices;
+        vertices.resize(vertexCount);
+        indices.resize(indexCount);
+        // Now wak through each of the mesh's faces (a face is a mesh its triangle) and copy their vertex indices
+        GLuint* index = indices.data();
+        for(GLuint i = 0; i < mesh->mNumFaces; i++)
+        {
+            const aiFace& face = mesh->mFaces[i];
+            memcpy(index, face.mIndices, face.mNumIndices * sizeof(GLuint));
+            index += face.mNumIndices;
+        }
+        
+        // ASSIMP's vectors are three packed floats, like glm::vec3, so each attribute is a plain 12 byte copy
+        static_assert(sizeof(aiVector3D) == sizeof(glm::vec3), "aiVector3D must be three floats");
+        const aiVector3D* positions = mesh->mVertices;
+        const aiVector3D* normals = mesh->mNormals;
+        const aiVector3D* texCoords = mesh->mTextureCoords[0];
+        const aiVector3D* tangents = mesh->mTangents && mesh->mBitangents ? mesh->mTangents : nullptr;
+        const aiVector3D* bitangents = tangents ? mesh->mBitangents : nullptr;
+        const glm::vec3 zero(0.0f);
+        for(GLuint i = 0; i < vertexCount; i++)
+        {
+            Vertex& vertex = vertices[i];
+            memcpy(&vertex.Position, positions ? &positions[i] : (const void*)&zero, sizeof(glm::vec3));
+            memcpy(&vertex.Normal, normals ? &normals[i] : (const void*)&zero, sizeof(glm::vec3));
+            // A vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+            // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+            memcpy(&vertex.TexCoords, texCoords ? &texCoords[i] : (const void*)&zero, sizeof(glm::vec2));
+            memcpy(&vertex.Tangent, tangents ? &tangents[i] : (const void*)&zero, sizeof(glm::vec3));
+            memcpy(&vertex.Bitangent, bitangents ? &bitangents[i] : (const void*)&zero, sizeof(glm::vec3));
+        }
+        if(!normals)
+        computeNormals(vertices, indices);
+        if(!tangents)
+        computeBasis(vertices);
+        
+        // Morph targets come as anim meshes holding the absolute positions (and normals) for every vertex
+        for(GLuint i = 0; i < mesh->mNumAnimMeshes; i++)
+        {
+            const aiAnimMesh* anim = mesh->mAnimMeshes[i];
+            if(!anim->mVertices || anim->mNumVertices != vertexCount)
+            continue;
+            MorphShape shape;
+            shape.positions.resize(vertexCount);
+            memcpy((void*)shape.positions.data(), anim->mVertices, vertexCount * sizeof(glm::vec3));
+            if(anim->mNormals)
+            {
+                shape.normals.resize(vertexCount);
+                memcpy((void*)shape.normals.data(), anim->mNormals, vertexCount * sizeof(glm::vec3));
+            }
+            pending.morphShapes.push_back(std::move(shape));
+        }
+    }
+    
+    // Area weighted vertex normals of a triangle list, for meshes that came without normals
+    static void computeNormals(vector<Vertex>& vertices, const vector<GLuint>& indices)
+    {
+        for(size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            Vertex& a = vertices[indices[i]];
+            Vertex& b = vertices[indices[i + 1]];
+            Vertex& c = vertices[indices[i + 2]];
+            // The cross product's length is twice the triangle's area, which does the weighting
+            glm::vec3 n = glm::cross(b.Position - a.Position, c.Position - a.Position);
+            a.Normal += n;
+            b.Normal += n;
+            c.Normal += n;
+        }
+        for(size_t i = 0; i < vertices.size(); i++)
+        {
+            GLfloat length = glm::length(vertices[i].Normal);
+            vertices[i].Normal = length > 0.0f ? vertices[i].Normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    }
+    
+    // Any orthonormal tangent frame around each normal, for meshes without tangents (ASSIMP can't compute them
+    // without texture coordinates, so normal maps can't apply to these meshes anyway)
+    static void computeBasis(vector<Vertex>& vertices)
+    {
+        for(size_t i = 0; i < vertices.size(); i++)
+        {
+            const glm::vec3& n = vertices[i].Normal;
+            glm::vec3 helper = fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            vertices[i].Tangent = glm::normalize(glm::cross(helper, n));
+            vertices[i].Bitangent = glm::cross(n, vertices[i].Tangent);
+        }
     }
     
     // Checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // The required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    // The required info is appended to textures as Texture structs.
+    void loadMaterialTextures(aiMaterial* mat, aiTextureType type, const string& typeName, vector<Texture>& textures)
     {
-        vector<Texture> textures;
         for(GLuint i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // Check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            GLboolean skip = false;
-            for(GLuint j = 0; j < textures_loaded.size(); j++)
+            textures.push_back(this->loadTexture(str, typeName));
+        }
+    }
+    
+    // Returns the texture record for a file relative to the model's directory, registering it only the first time it's asked for.
+    // The record's id is its index in textures_loaded; Import decodes the registered files and Upload swaps in the GL ids.
+    Texture loadTexture(const aiString& str, const string& typeName)
+    {
+        // Check if texture was loaded before and if so, skip loading a new texture
+        for(GLuint j = 0; j < textures_loaded.size(); j++)
+        {
+            if(textures_loaded[j].path == str)
             {
-                if(textures_loaded[j].path == str)
+                Texture texture = textures_loaded[j]; // A texture with the same filepath has already been loaded. (optimization)
+                texture.id = j;
+                return texture;
+            }
+        }
+        // If texture hasn't been loaded already, register it
+        Texture texture;
+        texture.id = (GLuint)this->textures_loaded.size();
+        texture.type = typeName;
+        texture.path = str;
+        this->textures_loaded.push_back(texture);  // Store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        this->pendingImages.emplace_back();
+        return texture;
+    }
+    
+    // Builds the meshes of an OBJ file read by the fast path: a root node with one child per OBJ object,
+    // like ASSIMP's OBJ importer produces.
+    void processObj(ObjScene& scene)
+    {
+        GLuint root = this->nodes.AddNode(-1, "root", glm::mat4());
+        for(GLuint i = 0; i < scene.objects.size(); i++)
+        {
+            this->nodes.AddNode(root, scene.objects[i].name, glm::mat4());
+            for(GLuint j = 0; j < scene.objects[i].meshes.size(); j++)
+            {
+                ObjMesh& mesh = scene.meshes[scene.objects[i].meshes[j]];
+                // Same sampler naming and order as processMesh: diffuse, specular, normal (bump), height (ambient)
+                vector<Texture> textures;
+                if(mesh.material >= 0)
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // A texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
+                    const ObjMaterial& material = scene.materials[mesh.material];
+                    if(!material.diffuseMap.empty())
+                    textures.push_back(this->loadTexture(aiString(material.diffuseMap), "texture_diffuse"));
+                    if(!material.specularMap.empty())
+                    textures.push_back(this->loadTexture(aiString(material.specularMap), "texture_specular"));
+                    if(!material.bumpMap.empty())
+                    textures.push_back(this->loadTexture(aiString(material.bumpMap), "texture_normal"));
+                    if(!material.ambientMap.empty())
+                    textures.push_back(this->loadTexture(aiString(material.ambientMap), "texture_height"));
                 }
-            }
-            if(!skip)
-            {   // If texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str;
-                textures.push_back(texture);
-                this->textures_loaded.push_back(texture);  // Store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                this->nodes.AddMesh((GLuint)(this->meshes.size() + this->pendingMeshes.size()));
+                PendingMesh pending = { std::move(mesh.vertices), std::move(mesh.indices), std::move(textures), vector<MorphShape>() };
+                this->pendingMeshes.push_back(std::move(pending));
             }
         }
-        return textures;
     }
 };
 
 
 
 
-GLint TextureFromFile(const char* path, string directory, bool gamma)
+// Decodes an image file (from the asset archive or a loose file) to RGB pixels
+TextureImage decodeImage(const string& filename)
 {
-    //Generate texture ID and load texture data
-    string filename = string(path);
-    filename = directory + '/' + filename;
-    GLuint textureID;
+    TextureImage image;
+    // Decode straight from the archive mapping (or the mapped loose file)
+    AssetData file;
+    if(file.Open(filename))
+    image.pixels = SOIL_load_image_from_memory((const unsigned char*)file.Data(), (int)file.Size(), &image.width, &image.height, 0, SOIL_LOAD_RGB);
+    if(!image.pixels)
+    cout << "ERROR::TEXTURE::DECODE_FAILED " << filename << endl;
+    return image;
+}
+
+// Creates a mipmapped 2D texture from decoded pixels and frees them. Given a textureID, respecifies that texture
+// instead (restoring an evicted one).
+GLuint uploadTexture(TextureImage& image, bool gamma, size_t* gpuBytes, GLuint textureID)
+{
+    if(textureID == 0)
     glGenTextures(1, &textureID);
-    int width,height;
-    unsigned char* image = SOIL_load_image(filename.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
     // Assign texture to ID
     glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, gamma ? GL_SRGB : GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+    glTexImage2D(GL_TEXTURE_2D, 0, gamma ? GL_SRGB : GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
     glGenerateMipmap(GL_TEXTURE_2D);
+    // Drivers store RGB8 padded to 4 bytes per texel, the mipmap chain adds another third
+    size_t bytes = (size_t)image.width * image.height * 4 * 4 / 3;
+    gpuResources().Track(RESOURCE_TEXTURE, textureID, bytes);
+    if(gpuBytes)
+    *gpuBytes = bytes;
     
     // Parameters
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
@@ -224,6 +799,43 @@ GLint TextureFromFile(const char* path, string directory, bool gamma)
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glBindTexture(GL_TEXTURE_2D, 0);
-    SOIL_free_image_data(image);
+    image = TextureImage();
+    return textureID;
+}
+
+GLint TextureFromFile(const char* path, string directory, bool gamma, size_t* gpuBytes)
+{
+    //Generate texture ID and load texture data
+    string filename = string(path);
+    filename = directory + '/' + filename;
+    TextureImage image = decodeImage(filename);
+    GLuint textureID = uploadTexture(image, gamma, gpuBytes);
+    setTextureEvictable(textureID, filename, gamma);
     return textureID;
 }
+
+// Frees a texture's storage but keeps its name (and every reference to it) valid: all mip levels but a 1x1 grey
+// base are respecified empty. Sampling it shows grey until it's uploaded again.
+void evictTexture(GLuint textureID)
+{
+    static const GLubyte grey[3] = { 128, 128, 128 };
+    GLint width = 0, height = 0;
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    for(GLint level = 1, size = max(width, height) / 2; size > 0; level++, size /= 2)
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Lets gpuResources() evict the texture under memory pressure; it's decoded from filename again on its next use
+void setTextureEvictable(GLuint textureID, const string& filename, bool gamma)
+{
+    gpuResources().SetEvictable(RESOURCE_TEXTURE, textureID, [textureID] { evictTexture(textureID); }, [textureID, filename, gamma]
+    {
+        TextureImage image = decodeImage(filename);
+        uploadTexture(image, gamma, nullptr, textureID);
+    });
+}
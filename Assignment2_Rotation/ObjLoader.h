@@ -0,0 +1,587 @@
+#pragma once
+// Std. Includes
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <charconv>
+#include <iostream>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "AssetArchive.h"
+#include "ThreadPool.h"
+
+// Fast path for Wavefront OBJ/MTL files. The file is memory mapped (or read in place from the asset archive), cut into line-aligned chunks that are parsed in parallel,
+// and each (object, material) pair is welded into a Mesh-ready interleaved vertex array. The result matches what ASSIMP
+// produces with aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace.
+
+// One face corner: 0-based indices into the position/texcoord/normal arrays, -1 if not given
+struct ObjCorner {
+    GLint v, vt, vn;
+};
+
+struct ObjMaterial {
+    string name;
+    string diffuseMap;      // map_Kd
+    string specularMap;     // map_Ks
+    string bumpMap;         // map_Bump / bump, ASSIMP reports these as aiTextureType_HEIGHT
+    string ambientMap;      // map_Ka, ASSIMP reports these as aiTextureType_AMBIENT
+};
+
+struct ObjMesh {
+    GLint material;         // Index into ObjScene::materials, -1 if the faces had no (known) material
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+};
+
+struct ObjObject {
+    string name;
+    vector<GLuint> meshes;
+};
+
+struct ObjScene {
+    vector<ObjObject> objects;
+    vector<ObjMesh> meshes;
+    vector<ObjMaterial> materials;
+};
+
+// Everything one chunk of the file contributes. Indices written as negative (relative) numbers can refer to vertices
+// in earlier chunks, so they are stored relative to the chunk and patched once all chunk sizes are known.
+struct ObjChunk {
+    // Starts a run of faces: an "o"/"g" or "usemtl" line. Empty strings with the inherit flags set mean "as before".
+    struct Group {
+        string object;
+        string material;
+        bool inheritObject;
+        bool inheritMaterial;
+        size_t firstCorner;
+    };
+    vector<glm::vec3> positions;
+    vector<glm::vec2> texCoords;
+    vector<glm::vec3> normals;
+    vector<ObjCorner> corners;          // 3 per triangle
+    vector<uint8_t> relative;           // Per corner: bit 0/1/2 set when v/vt/vn is chunk-relative
+    vector<Group> groups;
+    vector<string> libraries;
+};
+
+namespace obj {
+
+inline const char* skipSpaces(const char* p, const char* end)
+{
+    while(p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// strtof rather than from_chars: libc++ only has the floating point overloads from macOS 13.3. The token is copied
+// out first because the mapped file isn't null terminated.
+inline const char* parseFloat(const char* p, const char* end, float& out)
+{
+    p = skipSpaces(p, end);
+    char token[64];
+    size_t length = 0;
+    while(p + length < end && length < sizeof(token) - 1 && p[length] != ' ' && p[length] != '\t' && p[length] != '\r' && p[length] != '\n')
+    {
+        token[length] = p[length];
+        length++;
+    }
+    token[length] = '\0';
+    char* stop;
+    out = strtof(token, &stop);
+    if(stop == token)
+    {
+        out = 0.0f;
+        return p;
+    }
+    return p + (stop - token);
+}
+
+inline const char* parseInt(const char* p, const char* end, GLint& out, bool& ok)
+{
+    if(p < end && *p == '+')
+        p++;
+    from_chars_result result = from_chars(p, end, out);
+    ok = result.ec == errc();
+    return ok ? result.ptr : p;
+}
+
+// Rest of the line without surrounding whitespace
+inline string restOfLine(const char* p, const char* end)
+{
+    p = skipSpaces(p, end);
+    while(end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+        end--;
+    return string(p, end);
+}
+
+inline bool keyword(const char* p, const char* end, const char* word, size_t length)
+{
+    return (size_t)(end - p) > length && memcmp(p, word, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+}
+
+// Parses the lines in [begin, end), which must start at a line boundary
+inline void parseChunk(const char* begin, const char* end, ObjChunk& chunk)
+{
+    vector<ObjCorner> polygon;
+    vector<uint8_t> polygonRelative;
+    const char* line = begin;
+    while(line < end)
+    {
+        const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+        if(!lineEnd)
+            lineEnd = end;
+        const char* p = skipSpaces(line, lineEnd);
+        if(p + 1 < lineEnd)
+        {
+            if(p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                glm::vec3 v;
+                p = parseFloat(p + 1, lineEnd, v.x);
+                p = parseFloat(p, lineEnd, v.y);
+                parseFloat(p, lineEnd, v.z);
+                chunk.positions.push_back(v);
+            }
+            else if(p[0] == 'v' && p[1] == 't')
+            {
+                glm::vec2 t;
+                p = parseFloat(p + 2, lineEnd, t.x);
+                parseFloat(p, lineEnd, t.y);
+                chunk.texCoords.push_back(t);
+            }
+            else if(p[0] == 'v' && p[1] == 'n')
+            {
+                glm::vec3 n;
+                p = parseFloat(p + 2, lineEnd, n.x);
+                p = parseFloat(p, lineEnd, n.y);
+                parseFloat(p, lineEnd, n.z);
+                chunk.normals.push_back(n);
+            }
+            else if(p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                polygon.clear();
+                polygonRelative.clear();
+                p = skipSpaces(p + 1, lineEnd);
+                while(p < lineEnd && *p != '\r' && *p != '#')
+                {
+                    // v, v/vt, v//vn or v/vt/vn
+                    GLint values[3] = { 0, 0, 0 };
+                    bool present[3] = { false, false, false };
+                    for(int k = 0; k < 3; k++)
+                    {
+                        if(k > 0)
+                        {
+                            if(p >= lineEnd || *p != '/')
+                                break;
+                            p++;
+                        }
+                        bool ok;
+                        p = parseInt(p, lineEnd, values[k], ok);
+                        present[k] = ok && values[k] != 0;
+                    }
+                    if(!present[0])
+                        break;
+                    // Counts so far in this chunk resolve relative indices: -1 is the last one defined
+                    GLint counts[3] = { (GLint)chunk.positions.size(), (GLint)chunk.texCoords.size(), (GLint)chunk.normals.size() };
+                    GLint resolved[3];
+                    uint8_t relativeBits = 0;
+                    for(int k = 0; k < 3; k++)
+                    {
+                        if(!present[k])
+                            resolved[k] = -1;
+                        else if(values[k] < 0)
+                        {
+                            resolved[k] = counts[k] + values[k];
+                            relativeBits |= 1 << k;
+                        }
+                        else
+                            resolved[k] = values[k] - 1;
+                    }
+                    ObjCorner corner = { resolved[0], resolved[1], resolved[2] };
+                    polygon.push_back(corner);
+                    polygonRelative.push_back(relativeBits);
+                    p = skipSpaces(p, lineEnd);
+                }
+                // Triangulate as a fan, like aiProcess_Triangulate does for convex polygons
+                for(size_t k = 2; k < polygon.size(); k++)
+                {
+                    chunk.corners.push_back(polygon[0]);
+                    chunk.corners.push_back(polygon[k - 1]);
+                    chunk.corners.push_back(polygon[k]);
+                    chunk.relative.push_back(polygonRelative[0]);
+                    chunk.relative.push_back(polygonRelative[k - 1]);
+                    chunk.relative.push_back(polygonRelative[k]);
+                }
+            }
+            else if((p[0] == 'o' || p[0] == 'g') && (p[1] == ' ' || p[1] == '\t'))
+            {
+                ObjChunk::Group group = { restOfLine(p + 1, lineEnd), "", false, true, chunk.corners.size() };
+                chunk.groups.push_back(group);
+            }
+            else if(keyword(p, lineEnd, "usemtl", 6))
+            {
+                ObjChunk::Group group = { "", restOfLine(p + 6, lineEnd), true, false, chunk.corners.size() };
+                chunk.groups.push_back(group);
+            }
+            else if(keyword(p, lineEnd, "mtllib", 6))
+                chunk.libraries.push_back(restOfLine(p + 6, lineEnd));
+        }
+        line = lineEnd + 1;
+    }
+}
+
+// Texture file of a map_* statement. Options such as "-bm 0.5" come first, the file name (which may contain spaces) last.
+inline string mapFile(const char* p, const char* end)
+{
+    string value = restOfLine(p, end);
+    if(!value.empty() && value[0] == '-')
+    {
+        size_t space = value.find_last_of(" \t");
+        return space == string::npos ? value : value.substr(space + 1);
+    }
+    return value;
+}
+
+inline void parseMaterialLibrary(const string& path, vector<ObjMaterial>& materials)
+{
+    AssetData file;
+    if(!file.Open(path) || !file.Data())
+    {
+        cout << "ERROR::OBJ::MATERIAL_LIBRARY_NOT_FOUND " << path << endl;
+        return;
+    }
+    const char* line = file.Data();
+    const char* end = line + file.Size();
+    while(line < end)
+    {
+        const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+        if(!lineEnd)
+            lineEnd = end;
+        const char* p = skipSpaces(line, lineEnd);
+        if(keyword(p, lineEnd, "newmtl", 6))
+        {
+            ObjMaterial material;
+            material.name = restOfLine(p + 6, lineEnd);
+            materials.push_back(material);
+        }
+        else if(!materials.empty())
+        {
+            ObjMaterial& material = materials.back();
+            if(keyword(p, lineEnd, "map_Kd", 6))
+                material.diffuseMap = mapFile(p + 6, lineEnd);
+            else if(keyword(p, lineEnd, "map_Ks", 6))
+                material.specularMap = mapFile(p + 6, lineEnd);
+            else if(keyword(p, lineEnd, "map_Ka", 6))
+                material.ambientMap = mapFile(p + 6, lineEnd);
+            else if(keyword(p, lineEnd, "map_Bump", 8) || keyword(p, lineEnd, "map_bump", 8))
+                material.bumpMap = mapFile(p + 8, lineEnd);
+            else if(keyword(p, lineEnd, "bump", 4))
+                material.bumpMap = mapFile(p + 4, lineEnd);
+        }
+        line = lineEnd + 1;
+    }
+}
+
+// Open addressing hash table from a corner's (v, vt, vn) to its welded vertex index
+class CornerWelder
+{
+    public:
+    explicit CornerWelder(size_t expected)
+    {
+        size_t capacity = 16;
+        while(capacity < expected * 2)
+            capacity <<= 1;
+        this->mask = capacity - 1;
+        ObjCorner empty = { -1, -1, -1 };
+        this->keys.assign(capacity, empty);
+        this->values.resize(capacity);
+    }
+
+    // Returns the vertex index for the corner, inserting newIndex if it wasn't seen before
+    GLuint Insert(const ObjCorner& c, GLuint newIndex, bool& inserted)
+    {
+        uint64_t h = (uint64_t)(uint32_t)c.v * 0x9E3779B97F4A7C15ull ^ (uint64_t)(uint32_t)c.vt * 0xC2B2AE3D27D4EB4Full ^ (uint64_t)(uint32_t)c.vn * 0x165667B19E3779F9ull;
+        size_t slot = (size_t)(h ^ (h >> 29)) & this->mask;
+        for(;;)
+        {
+            ObjCorner& key = this->keys[slot];
+            if(key.v == -1)
+            {
+                key = c;
+                this->values[slot] = newIndex;
+                inserted = true;
+                return newIndex;
+            }
+            if(key.v == c.v && key.vt == c.vt && key.vn == c.vn)
+            {
+                inserted = false;
+                return this->values[slot];
+            }
+            slot = (slot + 1) & this->mask;
+        }
+    }
+
+    private:
+    vector<ObjCorner> keys;
+    vector<GLuint> values;
+    size_t mask;
+};
+
+// Corners of one output mesh, as ranges in the chunks' corner arrays
+struct MeshSource {
+    GLuint object;
+    GLint material;
+    vector<const ObjCorner*> rangeBegin;
+    vector<const ObjCorner*> rangeEnd;
+};
+
+// Builds interleaved vertices and indices for one mesh, generating normals and tangent frames where needed
+inline void weldMesh(const MeshSource& source, const vector<glm::vec3>& positions, const vector<glm::vec2>& texCoords,
+                     const vector<glm::vec3>& normals, ObjMesh& mesh)
+{
+    size_t cornerCount = 0;
+    for(size_t r = 0; r < source.rangeBegin.size(); r++)
+        cornerCount += source.rangeEnd[r] - source.rangeBegin[r];
+    CornerWelder welder(cornerCount);
+    mesh.material = source.material;
+    mesh.indices.resize(cornerCount);
+    mesh.vertices.reserve(cornerCount / 2 + 16);
+    bool missingNormals = false;
+    vector<uint8_t> generateNormal;
+    generateNormal.reserve(cornerCount / 2 + 16);
+    size_t out = 0;
+    for(size_t r = 0; r < source.rangeBegin.size(); r++)
+        for(const ObjCorner* c = source.rangeBegin[r]; c != source.rangeEnd[r]; c++)
+        {
+            bool inserted;
+            GLuint index = welder.Insert(*c, (GLuint)mesh.vertices.size(), inserted);
+            if(inserted)
+            {
+                Vertex vertex;
+                vertex.Position = positions[c->v];
+                if(c->vn >= 0)
+                    vertex.Normal = normals[c->vn];
+                else
+                {
+                    vertex.Normal = glm::vec3(0.0f);
+                    missingNormals = true;
+                }
+                generateNormal.push_back(c->vn < 0);
+                // aiProcess_FlipUVs
+                vertex.TexCoords = c->vt >= 0 ? glm::vec2(texCoords[c->vt].x, 1.0f - texCoords[c->vt].y) : glm::vec2(0.0f, 0.0f);
+                vertex.Tangent = glm::vec3(0.0f);
+                vertex.Bitangent = glm::vec3(0.0f);
+                mesh.vertices.push_back(vertex);
+            }
+            mesh.indices[out++] = index;
+        }
+
+    // Accumulate area weighted face normals (only where the file had none) and UV derived tangents per vertex
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        Vertex& a = mesh.vertices[mesh.indices[i]];
+        Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+        Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+        glm::vec3 e1 = b.Position - a.Position, e2 = c.Position - a.Position;
+        if(missingNormals)
+        {
+            // Vertices that came with a normal keep it, the others sum up the face normals around them
+            glm::vec3 n = glm::cross(e1, e2);
+            if(generateNormal[mesh.indices[i]]) a.Normal += n;
+            if(generateNormal[mesh.indices[i + 1]]) b.Normal += n;
+            if(generateNormal[mesh.indices[i + 2]]) c.Normal += n;
+        }
+        glm::vec2 d1 = b.TexCoords - a.TexCoords, d2 = c.TexCoords - a.TexCoords;
+        float det = d1.x * d2.y - d2.x * d1.y;
+        if(det == 0.0f)
+            continue;
+        float r = 1.0f / det;
+        glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) * r;
+        glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) * r;
+        a.Tangent += tangent; b.Tangent += tangent; c.Tangent += tangent;
+        a.Bitangent += bitangent; b.Bitangent += bitangent; c.Bitangent += bitangent;
+    }
+    for(size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        Vertex& v = mesh.vertices[i];
+        float nl = glm::length(v.Normal);
+        if(nl > 0.0f)
+            v.Normal = v.Normal / nl;
+        // Gram-Schmidt the tangent against the normal, fall back to any perpendicular axis for degenerate UVs
+        glm::vec3 t = v.Tangent - v.Normal * glm::dot(v.Normal, v.Tangent);
+        float tl = glm::length(t);
+        if(tl > 1e-8f)
+            t = t / tl;
+        else
+            t = glm::normalize(glm::cross(v.Normal, fabs(v.Normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+        float bl = glm::length(v.Bitangent);
+        v.Tangent = t;
+        v.Bitangent = bl > 1e-8f ? v.Bitangent / bl : glm::cross(v.Normal, t);
+    }
+}
+
+} // namespace obj
+
+// Loads an OBJ file and its material libraries. Returns false on anything the fast path doesn't handle
+// (missing file, out of range indices), in which case the caller should fall back to ASSIMP.
+inline bool loadObj(const string& path, ObjScene& scene, ThreadPool* pool = &workerPool())
+{
+    AssetData file;
+    if(!file.Open(path) || !file.Data())
+        return false;
+    const char* data = file.Data();
+    size_t size = file.Size();
+
+    // Cut the file into line aligned chunks of at least 256 KB, a few per thread for load balancing
+    size_t threads = pool ? pool->WorkerCount() + 1 : 1;
+    size_t chunkCount = max<size_t>(1, min(size / (256 * 1024), threads * 4));
+    vector<const char*> bounds(chunkCount + 1);
+    bounds[0] = data;
+    bounds[chunkCount] = data + size;
+    for(size_t k = 1; k < chunkCount; k++)
+    {
+        const char* p = data + size * k / chunkCount;
+        p = max(p, bounds[k - 1]);
+        const char* newline = (const char*)memchr(p, '\n', data + size - p);
+        bounds[k] = newline ? newline + 1 : data + size;
+    }
+    vector<ObjChunk> chunks(chunkCount);
+    function<void(size_t, size_t)> parse = [&](size_t begin, size_t end)
+    {
+        for(size_t k = begin; k < end; k++)
+            obj::parseChunk(bounds[k], bounds[k + 1], chunks[k]);
+    };
+    if(pool)
+        pool->ParallelFor(chunkCount, 1, parse);
+    else
+        parse(0, chunkCount);
+
+    // Concatenate the attribute arrays and turn chunk-relative indices into global ones
+    vector<GLint> positionBase(chunkCount), texCoordBase(chunkCount), normalBase(chunkCount);
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+    for(size_t k = 0; k < chunkCount; k++)
+    {
+        positionBase[k] = (GLint)positionCount;
+        texCoordBase[k] = (GLint)texCoordCount;
+        normalBase[k] = (GLint)normalCount;
+        positionCount += chunks[k].positions.size();
+        texCoordCount += chunks[k].texCoords.size();
+        normalCount += chunks[k].normals.size();
+    }
+    vector<glm::vec3> positions, normals;
+    vector<glm::vec2> texCoords;
+    positions.reserve(positionCount);
+    texCoords.reserve(texCoordCount);
+    normals.reserve(normalCount);
+    for(size_t k = 0; k < chunkCount; k++)
+    {
+        positions.insert(positions.end(), chunks[k].positions.begin(), chunks[k].positions.end());
+        texCoords.insert(texCoords.end(), chunks[k].texCoords.begin(), chunks[k].texCoords.end());
+        normals.insert(normals.end(), chunks[k].normals.begin(), chunks[k].normals.end());
+        vector<glm::vec3>().swap(chunks[k].positions);
+        vector<glm::vec2>().swap(chunks[k].texCoords);
+        vector<glm::vec3>().swap(chunks[k].normals);
+    }
+    bool valid = true;
+    for(size_t k = 0; k < chunkCount && valid; k++)
+    {
+        ObjChunk& chunk = chunks[k];
+        for(size_t i = 0; i < chunk.corners.size(); i++)
+        {
+            ObjCorner& c = chunk.corners[i];
+            uint8_t rel = chunk.relative[i];
+            if(rel & 1) c.v += positionBase[k];
+            if(rel & 2) c.vt += texCoordBase[k];
+            if(rel & 4) c.vn += normalBase[k];
+            if(c.v < 0 || c.v >= (GLint)positionCount || c.vt >= (GLint)texCoordCount || c.vn >= (GLint)normalCount || (rel & 2 && c.vt < 0) || (rel & 4 && c.vn < 0))
+            {
+                valid = false;
+                break;
+            }
+        }
+    }
+    if(!valid)
+    {
+        cout << "ERROR::OBJ::INDEX_OUT_OF_RANGE " << path << endl;
+        return false;
+    }
+
+    // Material libraries are looked up relative to the OBJ file
+    string directory = path.find_last_of('/') == string::npos ? string(".") : path.substr(0, path.find_last_of('/'));
+    for(size_t k = 0; k < chunkCount; k++)
+        for(size_t i = 0; i < chunks[k].libraries.size(); i++)
+            obj::parseMaterialLibrary(directory + '/' + chunks[k].libraries[i], scene.materials);
+    map<string, GLint> materialIndex;
+    for(size_t i = 0; i < scene.materials.size(); i++)
+        materialIndex[scene.materials[i].name] = (GLint)i;
+
+    // Resolve which object and material every run of faces belongs to, and gather the runs per (object, material)
+    vector<obj::MeshSource> sources;
+    map<pair<GLuint, GLint>, size_t> sourceIndex;
+    map<string, GLuint> objectIndex;
+    string object = "defaultobject";
+    GLint material = -1;
+    for(size_t k = 0; k < chunkCount; k++)
+    {
+        ObjChunk& chunk = chunks[k];
+        for(size_t g = 0; g <= chunk.groups.size(); g++)
+        {
+            size_t first = g == 0 ? 0 : chunk.groups[g - 1].firstCorner;
+            size_t last = g < chunk.groups.size() ? chunk.groups[g].firstCorner : chunk.corners.size();
+            if(last > first)
+            {
+                map<string, GLuint>::iterator found = objectIndex.find(object);
+                if(found == objectIndex.end())
+                {
+                    ObjObject o;
+                    o.name = object;
+                    scene.objects.push_back(o);
+                    found = objectIndex.insert(make_pair(object, (GLuint)scene.objects.size() - 1)).first;
+                }
+                pair<GLuint, GLint> key(found->second, material);
+                map<pair<GLuint, GLint>, size_t>::iterator source = sourceIndex.find(key);
+                if(source == sourceIndex.end())
+                {
+                    obj::MeshSource s;
+                    s.object = key.first;
+                    s.material = key.second;
+                    sources.push_back(s);
+                    source = sourceIndex.insert(make_pair(key, sources.size() - 1)).first;
+                }
+                sources[source->second].rangeBegin.push_back(chunk.corners.data() + first);
+                sources[source->second].rangeEnd.push_back(chunk.corners.data() + last);
+            }
+            if(g < chunk.groups.size())
+            {
+                if(!chunk.groups[g].inheritObject)
+                    object = chunk.groups[g].object;
+                if(!chunk.groups[g].inheritMaterial)
+                {
+                    map<string, GLint>::iterator found = materialIndex.find(chunk.groups[g].material);
+                    material = found == materialIndex.end() ? -1 : found->second;
+                }
+            }
+        }
+    }
+
+    // Weld every mesh independently
+    scene.meshes.resize(sources.size());
+    function<void(size_t, size_t)> weld = [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+            obj::weldMesh(sources[i], positions, texCoords, normals, scene.meshes[i]);
+    };
+    if(pool)
+        pool->ParallelFor(sources.size(), 1, weld);
+    else
+        weld(0, sources.size());
+    for(size_t i = 0; i < sources.size(); i++)
+        scene.objects[sources[i].object].meshes.push_back((GLuint)i);
+    return true;
+}
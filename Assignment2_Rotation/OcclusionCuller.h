@@ -0,0 +1,306 @@
+#pragma once
+// Std. Includes
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "ThreadPool.h"
+
+// Result of testing an object against the occlusion buffer
+enum Cull_Result {
+    CULL_VISIBLE = 0,
+    CULL_FRUSTUM,       // Entirely outside the view frustum
+    CULL_OCCLUDED       // Inside the frustum but behind the rasterized occluders
+};
+
+// What the culler did this frame
+struct OcclusionStats {
+    GLuint occluderTriangles;   // Triangles rasterized into the depth buffer
+    GLuint tested;              // Bounding boxes tested
+    GLuint frustumCulled;
+    GLuint occluded;
+    GLuint occludedTriangles;   // Triangles the culled objects would have submitted
+    GLfloat rasterMs;           // CPU time to transform and rasterize the occluders
+    GLfloat testMs;             // CPU time to test the boxes
+};
+
+// Software occlusion culling. Chosen occluders are rasterized into a small depth buffer on the CPU,
+// 4 pixels at a time with SSE, each worker thread filling its own band of rows. The buffer is reduced to a
+// hierarchical level holding the farthest depth of every 8x8 tile, and objects are tested by comparing the
+// nearest depth of their projected bounding box against the tiles it covers.
+// Depth is window z in [0, 1], 0 at the near plane. Everything errs on the side of visible: occluder triangles
+// that cross the near plane are skipped and boxes that cross it are never culled.
+class OcclusionCuller
+{
+    public:
+    static const GLint TILE_SIZE = 8;
+
+    // Width is rounded up to a multiple of the tile size, which also keeps rows aligned for the SIMD loops
+    OcclusionCuller(GLint width = 256, GLint height = 128)
+    : width((width + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE), height((height + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE)
+    {
+        this->tilesX = this->width / TILE_SIZE;
+        this->tilesY = this->height / TILE_SIZE;
+        this->depth.resize((size_t)this->width * this->height);
+        this->tileMax.resize((size_t)this->tilesX * this->tilesY);
+        this->resetStats();
+    }
+
+    // Starts a frame: forgets last frame's occluders and sets the camera they and the tested boxes are seen through
+    void BeginFrame(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        this->triangles.clear();
+        this->resetStats();
+    }
+
+    // Queues an occluder's triangles for this frame. positions are in object space, model places them in the world.
+    void AddOccluder(const glm::mat4& model, const glm::vec3* positions, size_t positionCount, const GLuint* indices, size_t indexCount)
+    {
+        auto start = chrono::steady_clock::now();
+        glm::mat4 mvp = this->viewProjection * model;
+        this->clip.resize(positionCount);
+        for(size_t i = 0; i < positionCount; i++)
+            this->clip[i] = mvp * glm::vec4(positions[i], 1.0f);
+        for(size_t i = 0; i + 2 < indexCount; i += 3)
+            this->setupTriangle(this->clip[indices[i]], this->clip[indices[i + 1]], this->clip[indices[i + 2]]);
+        this->stats.rasterMs += chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Rasterizes the queued occluders and builds the tile level. Call once after the last AddOccluder.
+    void Rasterize(ThreadPool* pool = &workerPool())
+    {
+        auto start = chrono::steady_clock::now();
+        this->stats.occluderTriangles = (GLuint)this->triangles.size();
+        // One tile row per job, so each job can reduce its own rows to tiles without waiting for the others
+        auto rasterizeRows = [this](size_t begin, size_t end)
+        {
+            for(size_t tileRow = begin; tileRow < end; tileRow++)
+            {
+                GLint y0 = (GLint)tileRow * TILE_SIZE;
+                fill(this->depth.begin() + (size_t)y0 * this->width, this->depth.begin() + (size_t)(y0 + TILE_SIZE) * this->width, 1.0f);
+                for(size_t i = 0; i < this->triangles.size(); i++)
+                    this->rasterizeTriangle(this->triangles[i], y0, y0 + TILE_SIZE);
+                this->reduceTileRow((GLint)tileRow);
+            }
+        };
+        if(pool)
+            pool->ParallelFor(this->tilesY, 1, rasterizeRows);
+        else
+            rasterizeRows(0, this->tilesY);
+        this->stats.rasterMs += chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Classifies an object space bounding box placed by model. Safe to call from several threads at once.
+    Cull_Result TestBox(const glm::mat4& model, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+    {
+        glm::mat4 mvp = this->viewProjection * model;
+        GLfloat minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+        GLuint outside[6] = { 0, 0, 0, 0, 0, 0 };
+        bool crossesNear = false;
+        for(GLuint corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 p((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+            glm::vec4 c = mvp * glm::vec4(p, 1.0f);
+            // Frustum planes in clip space: a box is outside if all corners are beyond the same plane
+            outside[0] += c.x < -c.w;
+            outside[1] += c.x > c.w;
+            outside[2] += c.y < -c.w;
+            outside[3] += c.y > c.w;
+            outside[4] += c.z < -c.w;
+            outside[5] += c.z > c.w;
+            if(c.w <= NEAR_W)
+            {
+                crossesNear = true;
+                continue;
+            }
+            GLfloat invW = 1.0f / c.w;
+            GLfloat x = (c.x * invW * 0.5f + 0.5f) * this->width;
+            GLfloat y = (c.y * invW * 0.5f + 0.5f) * this->height;
+            minX = min(minX, x);
+            maxX = max(maxX, x);
+            minY = min(minY, y);
+            maxY = max(maxY, y);
+            nearest = min(nearest, c.z * invW * 0.5f + 0.5f);
+        }
+        for(GLuint plane = 0; plane < 6; plane++)
+            if(outside[plane] == 8)
+                return CULL_FRUSTUM;
+        if(crossesNear)
+            return CULL_VISIBLE;
+
+        GLint tx0 = max(0, (GLint)floor(minX) / TILE_SIZE), tx1 = min(this->tilesX - 1, (GLint)ceil(maxX) / TILE_SIZE);
+        GLint ty0 = max(0, (GLint)floor(minY) / TILE_SIZE), ty1 = min(this->tilesY - 1, (GLint)ceil(maxY) / TILE_SIZE);
+        for(GLint ty = ty0; ty <= ty1; ty++)
+            for(GLint tx = tx0; tx <= tx1; tx++)
+                if(nearest <= this->tileMax[(size_t)ty * this->tilesX + tx])
+                    return CULL_VISIBLE;
+        return CULL_OCCLUDED;
+    }
+
+    // Adds the outcome of a test to this frame's statistics (not thread safe, call after the tests)
+    void Record(Cull_Result result, GLuint triangleCount)
+    {
+        this->stats.tested++;
+        if(result == CULL_FRUSTUM)
+            this->stats.frustumCulled++;
+        else if(result == CULL_OCCLUDED)
+        {
+            this->stats.occluded++;
+            this->stats.occludedTriangles += triangleCount;
+        }
+    }
+
+    void AddTestTime(GLfloat ms)
+    {
+        this->stats.testMs += ms;
+    }
+
+    const OcclusionStats& Stats() const { return this->stats; }
+    GLint Width() const { return this->width; }
+    GLint Height() const { return this->height; }
+    const GLfloat* Depth() const { return this->depth.data(); }
+
+    private:
+    // Screen space triangle ready for rasterization: edge functions and depth as planes in (x, y)
+    struct Triangle {
+        GLfloat edgeA[3], edgeB[3], edgeC[3];
+        GLfloat zA, zB, zC;
+        GLint minX, minY, maxX, maxY;
+    };
+
+    static constexpr GLfloat NEAR_W = 1e-5f;
+
+    GLint width, height;
+    GLint tilesX, tilesY;
+    vector<GLfloat> depth;
+    vector<GLfloat> tileMax;         // Farthest occluder depth in each tile
+    vector<glm::vec4> clip;          // Scratch for the occluder being added
+    vector<Triangle> triangles;
+    glm::mat4 viewProjection;
+    OcclusionStats stats;
+
+    void resetStats()
+    {
+        this->stats.occluderTriangles = 0;
+        this->stats.tested = 0;
+        this->stats.frustumCulled = 0;
+        this->stats.occluded = 0;
+        this->stats.occludedTriangles = 0;
+        this->stats.rasterMs = 0.0f;
+        this->stats.testMs = 0.0f;
+    }
+
+    void setupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2)
+    {
+        // Clipping against the near plane isn't worth it for occluders, skipping the triangle only loses some culling.
+        // A vertex in front of the near plane would get a depth below 0 and occlude everything behind it.
+        // The w test keeps the divide safe whatever the projection.
+        if(c0.z < -c0.w || c1.z < -c1.w || c2.z < -c2.w || c0.w <= NEAR_W || c1.w <= NEAR_W || c2.w <= NEAR_W)
+            return;
+        GLfloat x[3], y[3], z[3];
+        const glm::vec4* c[3] = { &c0, &c1, &c2 };
+        for(GLuint i = 0; i < 3; i++)
+        {
+            GLfloat invW = 1.0f / c[i]->w;
+            x[i] = (c[i]->x * invW * 0.5f + 0.5f) * this->width;
+            y[i] = (c[i]->y * invW * 0.5f + 0.5f) * this->height;
+            z[i] = c[i]->z * invW * 0.5f + 0.5f;
+        }
+        GLfloat area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if(fabs(area) < 1e-6f)
+            return;
+        Triangle t;
+        t.minX = max(0, (GLint)floor(min(x[0], min(x[1], x[2]))));
+        t.maxX = min(this->width - 1, (GLint)ceil(max(x[0], max(x[1], x[2]))));
+        t.minY = max(0, (GLint)floor(min(y[0], min(y[1], y[2]))));
+        t.maxY = min(this->height - 1, (GLint)ceil(max(y[0], max(y[1], y[2]))));
+        if(t.minX > t.maxX || t.minY > t.maxY)
+            return;
+        // Both windings are drawn, so flip the edges of clockwise triangles to keep the inside positive
+        GLfloat sign = area > 0.0f ? 1.0f : -1.0f;
+        for(GLuint i = 0; i < 3; i++)
+        {
+            GLuint a = (i + 1) % 3, b = (i + 2) % 3;
+            t.edgeA[i] = (y[a] - y[b]) * sign;
+            t.edgeB[i] = (x[b] - x[a]) * sign;
+            t.edgeC[i] = (x[a] * y[b] - x[b] * y[a]) * sign;
+        }
+        // Depth plane from the barycentric weights, which are the edge functions divided by the area
+        GLfloat invArea = sign / area;
+        t.zA = (t.edgeA[0] * z[0] + t.edgeA[1] * z[1] + t.edgeA[2] * z[2]) * invArea;
+        t.zB = (t.edgeB[0] * z[0] + t.edgeB[1] * z[1] + t.edgeB[2] * z[2]) * invArea;
+        t.zC = (t.edgeC[0] * z[0] + t.edgeC[1] * z[1] + t.edgeC[2] * z[2]) * invArea;
+        this->triangles.push_back(t);
+    }
+
+    // Rasterizes the part of a triangle within rows [rowBegin, rowEnd), testing pixel centers
+    void rasterizeTriangle(const Triangle& t, GLint rowBegin, GLint rowEnd)
+    {
+        GLint y0 = max(t.minY, rowBegin), y1 = min(t.maxY, rowEnd - 1);
+        if(y0 > y1)
+            return;
+        GLint x0 = t.minX & ~3;
+#if defined(__SSE2__)
+        const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        for(GLint y = y0; y <= y1; y++)
+        {
+            GLfloat py = y + 0.5f;
+            GLfloat* row = this->depth.data() + (size_t)y * this->width;
+            for(GLint x = x0; x <= t.maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((GLfloat)x), offsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[0]), px), _mm_set1_ps(t.edgeB[0] * py + t.edgeC[0]));
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[1]), px), _mm_set1_ps(t.edgeB[1] * py + t.edgeC[1]));
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[2]), px), _mm_set1_ps(t.edgeB[2] * py + t.edgeC[2]));
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if(_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.zA), px), _mm_set1_ps(t.zB * py + t.zC));
+                __m128 old = _mm_load_ps(row + x);
+                // Masked depth update: keep the old value outside the triangle, the nearer one inside
+                __m128 nearer = _mm_min_ps(old, z);
+                _mm_store_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+        }
+#else
+        for(GLint y = y0; y <= y1; y++)
+        {
+            GLfloat py = y + 0.5f;
+            GLfloat* row = this->depth.data() + (size_t)y * this->width;
+            for(GLint x = x0; x <= t.maxX; x++)
+            {
+                GLfloat px = x + 0.5f;
+                if(t.edgeA[0] * px + t.edgeB[0] * py + t.edgeC[0] < 0.0f || t.edgeA[1] * px + t.edgeB[1] * py + t.edgeC[1] < 0.0f
+                   || t.edgeA[2] * px + t.edgeB[2] * py + t.edgeC[2] < 0.0f)
+                    continue;
+                row[x] = min(row[x], t.zA * px + t.zB * py + t.zC);
+            }
+        }
+#endif
+    }
+
+    void reduceTileRow(GLint tileRow)
+    {
+        for(GLint tx = 0; tx < this->tilesX; tx++)
+        {
+            GLfloat farthest = 0.0f;
+            for(GLint y = 0; y < TILE_SIZE; y++)
+            {
+                const GLfloat* row = this->depth.data() + (size_t)(tileRow * TILE_SIZE + y) * this->width + tx * TILE_SIZE;
+                for(GLint x = 0; x < TILE_SIZE; x++)
+                    farthest = max(farthest, row[x]);
+            }
+            this->tileMax[(size_t)tileRow * this->tilesX + tx] = farthest;
+        }
+    }
+};
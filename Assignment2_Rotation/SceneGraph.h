@@ -0,0 +1,137 @@
+#pragma once
+// Std. Includes
+#include <string>
+#include <vector>
+#include <cstdint>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <assimp/scene.h>
+
+// Flat scene graph built from ASSIMP's node hierarchy.
+// Nodes are stored in depth-first pre-order, so every parent comes before its children and a node's whole
+// subtree is the contiguous range [i, subtreeEnd[i]). Transforms are kept as separate arrays (SoA) and only
+// the subtrees whose local transform changed are recomputed by Update().
+class SceneGraph
+{
+    public:
+    /*  Node Data  */
+    vector<GLint> parent;           // Index of the parent node, -1 for the root
+    vector<GLuint> subtreeEnd;      // One past the last node of this node's subtree
+    vector<glm::mat4> local;        // Transform relative to the parent
+    vector<glm::mat4> world;        // Transform relative to the model origin
+    vector<uint8_t> dirty;          // Set when local changed since the last Update()
+    vector<string> names;
+    // Meshes attached to each node: meshIndices[meshBegin[i] .. meshBegin[i+1])
+    vector<GLuint> meshBegin;
+    vector<GLuint> meshIndices;
+
+    /*  Functions   */
+    SceneGraph() : dirtyCount(0)
+    {
+        this->meshBegin.push_back(0);
+    }
+
+    // Appends a node as the last child of parentIndex. Nodes must be added in depth-first pre-order.
+    GLuint AddNode(GLint parentIndex, const string& name, const glm::mat4& transform)
+    {
+        GLuint index = (GLuint)this->parent.size();
+        this->parent.push_back(parentIndex);
+        this->subtreeEnd.push_back(index + 1);
+        this->local.push_back(transform);
+        this->world.push_back(transform);
+        this->dirty.push_back(1);
+        this->names.push_back(name);
+        this->meshBegin.push_back(this->meshBegin.back());
+        this->dirtyCount++;
+        // Grow the subtree range of every ancestor to include the new node
+        for(GLint p = parentIndex; p >= 0; p = this->parent[p])
+            this->subtreeEnd[p] = index + 1;
+        return index;
+    }
+
+    // Attaches a mesh to the most recently added node
+    void AddMesh(GLuint meshIndex)
+    {
+        this->meshIndices.push_back(meshIndex);
+        this->meshBegin.back()++;
+    }
+
+    // Replaces a node's local transform and flags its subtree for recomputation
+    void SetLocalTransform(GLuint node, const glm::mat4& transform)
+    {
+        this->local[node] = transform;
+        if(!this->dirty[node])
+        {
+            this->dirty[node] = 1;
+            this->dirtyCount++;
+        }
+    }
+
+    // Recomputes the world transforms of all dirty subtrees. Clean subtrees are skipped as a whole.
+    void Update()
+    {
+        if(this->dirtyCount == 0)
+            return;
+        GLuint count = (GLuint)this->parent.size();
+        GLuint i = 0;
+        while(i < count)
+        {
+            if(!this->dirty[i])
+            {
+                i++;
+                continue;
+            }
+            // Every node below i depends on i's new world transform, so refresh the whole range in order.
+            GLuint end = this->subtreeEnd[i];
+            for(GLuint j = i; j < end; j++)
+            {
+                GLint p = this->parent[j];
+                this->world[j] = p >= 0 ? this->world[p] * this->local[j] : this->local[j];
+                this->dirty[j] = 0;
+            }
+            i = end;
+        }
+        this->dirtyCount = 0;
+    }
+
+    // Returns the index of the first node with the given name, or -1 if there is none
+    GLint FindNode(const string& name) const
+    {
+        for(GLuint i = 0; i < this->names.size(); i++)
+            if(this->names[i] == name)
+                return i;
+        return -1;
+    }
+
+    GLuint NodeCount() const
+    {
+        return (GLuint)this->parent.size();
+    }
+
+    // Bytes held by the node arrays
+    size_t CpuBytes() const
+    {
+        size_t bytes = this->parent.capacity() * sizeof(GLint) + this->subtreeEnd.capacity() * sizeof(GLuint)
+                     + (this->local.capacity() + this->world.capacity()) * sizeof(glm::mat4) + this->dirty.capacity()
+                     + (this->meshBegin.capacity() + this->meshIndices.capacity()) * sizeof(GLuint);
+        for(GLuint i = 0; i < this->names.size(); i++)
+            bytes += sizeof(string) + this->names[i].capacity();
+        return bytes;
+    }
+
+    private:
+    GLuint dirtyCount;
+};
+
+// ASSIMP matrices are row-major, glm matrices are column-major
+inline glm::mat4 toGlm(const aiMatrix4x4& m)
+{
+    return glm::mat4(glm::vec4(m.a1, m.b1, m.c1, m.d1),
+                     glm::vec4(m.a2, m.b2, m.c2, m.d2),
+                     glm::vec4(m.a3, m.b3, m.c3, m.d3),
+                     glm::vec4(m.a4, m.b4, m.c4, m.d4));
+}
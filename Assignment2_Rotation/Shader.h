@@ -2,80 +2,85 @@
 #define SHADER_H
 
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
 
 #include <GL/glew.h>
 
+#include "AssetArchive.h"
+#include "GLHandle.h"
+
+// Fixed binding points of the uniform blocks shared by all programs
+const GLuint UNIFORM_BINDING_CAMERA = 0;   // uniform Camera: per-frame projection/view
+const GLuint UNIFORM_BINDING_OBJECT = 1;   // uniform Object: per-draw model matrix
+
+// Owns its program, so it can be moved but not copied
 class Shader
 {
 public:
-    GLuint Program;
+    GLuint Program;     // Name of the owned program, for glUniform* calls
+    // Default constructor, the program is built later with Compile and Finish
+    Shader( ) : Program( 0 ), vertex( 0 ), fragment( 0 ) { }
     // Constructor generates the shader on the fly
-    Shader( const GLchar *vertexPath, const GLchar *fragmentPath )
+    Shader( const GLchar *vertexPath, const GLchar *fragmentPath ) : Program( 0 ), vertex( 0 ), fragment( 0 )
     {
-        // 1. Retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensures ifstream objects can throw exceptions:
-        vShaderFile.exceptions ( std::ifstream::badbit );
-        fShaderFile.exceptions ( std::ifstream::badbit );
-        try
-        {
-            // Open files
-            vShaderFile.open( vertexPath );
-            fShaderFile.open( fragmentPath );
-            std::stringstream vShaderStream, fShaderStream;
-            // Read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf( );
-            fShaderStream << fShaderFile.rdbuf( );
-            // close file handlers
-            vShaderFile.close( );
-            fShaderFile.close( );
-            // Convert stream into string
-            vertexCode = vShaderStream.str( );
-            fragmentCode = fShaderStream.str( );
-        }
-        catch ( std::ifstream::failure e )
+        this->Compile( vertexPath, fragmentPath );
+        this->Finish( );
+    }
+    // Lets the driver compile on its own threads, so Compile returns right away and the work overlaps whatever
+    // the caller does until Finish. Call once after the context has been created.
+    static void EnableParallelCompile( )
+    {
+        if ( GLEW_KHR_parallel_shader_compile )
+            glMaxShaderCompilerThreadsKHR( 0xFFFFFFFF );
+    }
+    // Submits the compile and link without asking for their results, which would make the driver wait for them
+    void Compile( const GLchar *vertexPath, const GLchar *fragmentPath )
+    {
+        // 1. Retrieve the vertex/fragment source code from filePath (or from the asset archive, without copying)
+        AssetData vShaderFile;
+        AssetData fShaderFile;
+        if ( !vShaderFile.Open( vertexPath ) || !fShaderFile.Open( fragmentPath ) )
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        const GLchar *vShaderCode = vertexCode.c_str( );
-        const GLchar *fShaderCode = fragmentCode.c_str( );
+        const GLchar *vShaderCode = vShaderFile.Data( ) ? vShaderFile.Data( ) : "";
+        const GLchar *fShaderCode = fShaderFile.Data( ) ? fShaderFile.Data( ) : "";
+        GLint vShaderLength = ( GLint )vShaderFile.Size( );
+        GLint fShaderLength = ( GLint )fShaderFile.Size( );
         // 2. Compile shaders
-        GLuint vertex, fragment;
+        // Vertex Shader
+        this->vertex = glCreateShader( GL_VERTEX_SHADER );
+        glShaderSource( this->vertex, 1, &vShaderCode, &vShaderLength );
+        glCompileShader( this->vertex );
+        // Fragment Shader
+        this->fragment = glCreateShader( GL_FRAGMENT_SHADER );
+        glShaderSource( this->fragment, 1, &fShaderCode, &fShaderLength );
+        glCompileShader( this->fragment );
+        // Shader Program
+        this->program = GLProgram::Create( );
+        this->Program = this->program.Get( );
+        glAttachShader( this->Program, this->vertex );
+        glAttachShader( this->Program, this->fragment );
+        glLinkProgram( this->Program );
+    }
+    // Reports compile and link errors and sets up the uniform block bindings. Waits for the compile if it's still running.
+    void Finish( )
+    {
         GLint success;
         GLchar infoLog[512];
-        // Vertex Shader
-        vertex = glCreateShader( GL_VERTEX_SHADER );
-        glShaderSource( vertex, 1, &vShaderCode, NULL );
-        glCompileShader( vertex );
         // Print compile errors if any
-        glGetShaderiv( vertex, GL_COMPILE_STATUS, &success );
+        glGetShaderiv( this->vertex, GL_COMPILE_STATUS, &success );
         if ( !success )
         {
-            glGetShaderInfoLog( vertex, 512, NULL, infoLog );
+            glGetShaderInfoLog( this->vertex, 512, NULL, infoLog );
             std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
         }
-        // Fragment Shader
-        fragment = glCreateShader( GL_FRAGMENT_SHADER );
-        glShaderSource( fragment, 1, &fShaderCode, NULL );
-        glCompileShader( fragment );
-        // Print compile errors if any
-        glGetShaderiv( fragment, GL_COMPILE_STATUS, &success );
+        glGetShaderiv( this->fragment, GL_COMPILE_STATUS, &success );
         if ( !success )
         {
-            glGetShaderInfoLog( fragment, 512, NULL, infoLog );
+            glGetShaderInfoLog( this->fragment, 512, NULL, infoLog );
             std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
         }
-        // Shader Program
-        this->Program = glCreateProgram( );
-        glAttachShader( this->Program, vertex );
-        glAttachShader( this->Program, fragment );
-        glLinkProgram( this->Program );
         // Print linking errors if any
         glGetProgramiv( this->Program, GL_LINK_STATUS, &success );
         if (!success)
@@ -84,15 +89,33 @@ public:
             std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
         }
         // Delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader( vertex );
-        glDeleteShader( fragment );
-        
+        glDeleteShader( this->vertex );
+        glDeleteShader( this->fragment );
+        this->vertex = this->fragment = 0;
+        // The driver's binary is the closest thing to the program's memory footprint that GL exposes
+        GLint binaryLength = 0;
+        if ( GLEW_ARB_get_program_binary )
+            glGetProgramiv( this->Program, GL_PROGRAM_BINARY_LENGTH, &binaryLength );
+        gpuResources( ).Track( RESOURCE_PROGRAM, this->Program, ( size_t )binaryLength );
+        // Hook the shared uniform blocks up to their binding points (programs that don't declare them are left alone)
+        this->BindUniformBlock( "Camera", UNIFORM_BINDING_CAMERA );
+        this->BindUniformBlock( "Object", UNIFORM_BINDING_OBJECT );
+    }
+    // Assigns a uniform block of this program to a binding point, if the program has a block with that name
+    void BindUniformBlock( const GLchar *blockName, GLuint binding )
+    {
+        GLuint index = glGetUniformBlockIndex( this->Program, blockName );
+        if ( index != GL_INVALID_INDEX )
+            glUniformBlockBinding( this->Program, index, binding );
     }
     // Uses the current shader
     void Use( )
     {
         glUseProgram( this->Program );
     }
+private:
+    GLProgram program;
+    GLuint vertex, fragment;    // Only set between Compile and Finish
 };
 
 #endif
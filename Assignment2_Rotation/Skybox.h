@@ -0,0 +1,462 @@
+#pragma once
+// Std. Includes
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "GLHandle.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Model.h"
+
+// Cube map cache file. Layout:
+//   SkyboxCacheHeader
+//   DXT1 blocks of the six faces (+X, -X, +Y, -Y, +Z, -Z), each face's mip chain from level 0 down to 1x1
+const uint32_t SKYBOX_CACHE_MAGIC = 0x43594B53;    // "SKYC"
+const uint32_t SKYBOX_CACHE_VERSION = 1;
+
+struct SkyboxCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t faceSize;          // Width and height of level 0
+    uint32_t levels;
+    uint64_t sourceHash;        // Of the face files' contents, so editing a face invalidates the cache
+    uint64_t dataSize;
+};
+
+// Where the last Skybox::Import spent its time
+struct SkyboxTimings {
+    GLfloat hashMs;             // Hashing the face files to validate the cache
+    GLfloat decodeMs;           // Decoding the faces (cache miss only)
+    GLfloat compressMs;         // Building the mip chains and compressing them (cache miss only)
+    GLfloat loadMs;             // Import in total
+    bool cached;
+};
+
+// Sky drawn as one triangle covering the screen, after the opaque geometry. The vertex shader puts it on the far
+// plane (depth 1) and the depth test (LEQUAL) keeps only the pixels nothing else covered, which early depth
+// testing rejects before shading. View directions come from the inverse of the rotation-only view-projection,
+// which the shader reads from the Camera block.
+// The cube map is mipmapped and DXT1 compressed, about an eighth of the uncompressed size. The first Import
+// decodes and compresses the faces in parallel and writes the result to a cache file, later ones map that file
+// and upload it as it is. DrawCube draws the sky the old way, as a cube of 36 vertices, to measure what the triangle saves.
+class Skybox
+{
+    public:
+    SkyboxTimings timings;
+
+    Skybox() : faceSize(0), levels(0), data(nullptr), dataSize(0)
+    {
+        this->timings = SkyboxTimings{ 0.0f, 0.0f, 0.0f, 0.0f, false };
+    }
+
+    Skybox(const Skybox&) = delete;
+    Skybox& operator=(const Skybox&) = delete;
+
+    // Loads the six faces (+X, -X, +Y, -Y, +Z, -Z; square, all the same size) from the cache file if it matches
+    // them, otherwise decodes and compresses them on pool and writes the cache. Doesn't touch GL.
+    bool Import(const vector<string>& faces, const string& cachePath, ThreadPool* pool = &workerPool())
+    {
+        auto start = chrono::steady_clock::now();
+        this->release();
+        this->timings = SkyboxTimings{ 0.0f, 0.0f, 0.0f, 0.0f, false };
+
+        // A missing face fails the import, the cache would otherwise still match the faces that are left
+        uint64_t sourceHash = 0xcbf29ce484222325ull;
+        for(const string& face : faces)
+        {
+            AssetData file;
+            if(!file.Open(face))
+            {
+                cout << "ERROR::SKYBOX::FACE_NOT_FOUND " << face << endl;
+                return false;
+            }
+            sourceHash = fnv1a(file.Data(), file.Size(), sourceHash);
+        }
+        this->timings.hashMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count();
+
+        bool loaded = faces.size() == 6 && (this->readCache(cachePath, sourceHash) || this->build(faces, cachePath, sourceHash, pool));
+        this->timings.loadMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count();
+        return loaded;
+    }
+
+    // Creates the cube map from what Import loaded, the empty vertex array the triangle is drawn with and the cube
+    void Upload()
+    {
+        this->vertexArray = GLVertexArray::Create();
+        gpuResources().Track(RESOURCE_VERTEX_ARRAY, this->vertexArray.Get(), 0);
+        this->uploadCube();
+        if(!this->data)
+        return;
+
+        this->cubemap = GLTexture::Create();
+        glBindTexture(GL_TEXTURE_CUBE_MAP, this->cubemap.Get());
+        bool compressed = GLEW_EXT_texture_compression_s3tc;
+        vector<GLubyte> pixels;
+        if(!compressed)
+        {
+            pixels.resize((size_t)this->faceSize * this->faceSize * 3);
+            // Rows of odd sized levels aren't 4 byte aligned
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        }
+        size_t gpuBytes = 0;
+        for(GLuint face = 0; face < 6; face++)
+        for(GLuint level = 0; level < this->levels; level++)
+        {
+            GLuint size = max(this->faceSize >> level, 1u);
+            const GLubyte* blocks = this->data + face * this->faceBytes() + levelOffset(this->faceSize, level);
+            GLsizei bytes = (GLsizei)levelBytes(size);
+            if(compressed)
+            glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, size, size, 0, bytes, blocks);
+            else
+            {
+                // Without S3TC (never the case on macOS) the blocks are expanded again
+                decompressLevel(blocks, size, pixels.data());
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+                bytes = (GLsizei)size * size * 4;
+            }
+            gpuBytes += bytes;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, this->levels - 1);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        // Filter across face edges, otherwise the smaller mip levels show the cube's seams
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        gpuResources().Track(RESOURCE_TEXTURE, this->cubemap.Get(), gpuBytes);
+        this->release();
+    }
+
+    // Points the sky shader's sampler at texture unit 0. Call once after linking it.
+    static void SetupShader(Shader& shader)
+    {
+        shader.Use();
+        glUniform1i(glGetUniformLocation(shader.Program, "skybox"), 0);
+    }
+
+    // Draws the sky behind everything drawn so far with the shader in use and the Camera block bound.
+    // Needs the depth test with GL_LEQUAL.
+    void Draw() const
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, this->cubemap.Get());
+        // The sky never occludes anything, its depth isn't needed
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(this->vertexArray.Get());
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glDepthMask(GL_TRUE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+
+    // Draws the sky as a 20 unit cube around the origin with the shader in use (skybox_cube.vs) and the Camera block
+    // bound, the way it was drawn before Draw. Only there to compare their fill cost.
+    void DrawCube() const
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, this->cubemap.Get());
+        glBindVertexArray(this->cubeArray.Get());
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+
+    GLuint FaceSize() const
+    {
+        return this->faceSize;
+    }
+
+    // Bytes of the compressed cube map with its mip chains
+    size_t CompressedBytes() const
+    {
+        return this->faceBytes() * 6;
+    }
+
+    // Expands DXT1 blocks to RGB pixels, for a level of size x size texels
+    static void decompressLevel(const GLubyte* blocks, GLuint size, GLubyte* rgb)
+    {
+        for(GLuint by = 0; by < size; by += 4)
+        for(GLuint bx = 0; bx < size; bx += 4, blocks += 8)
+        {
+            GLubyte palette[4][3];
+            GLushort c0 = (GLushort)(blocks[0] | blocks[1] << 8), c1 = (GLushort)(blocks[2] | blocks[3] << 8);
+            expand565(c0, palette[0]);
+            expand565(c1, palette[1]);
+            for(GLuint c = 0; c < 3; c++)
+            {
+                palette[2][c] = (GLubyte)(c0 > c1 ? (2 * palette[0][c] + palette[1][c]) / 3 : (palette[0][c] + palette[1][c]) / 2);
+                palette[3][c] = (GLubyte)(c0 > c1 ? (palette[0][c] + 2 * palette[1][c]) / 3 : 0);
+            }
+            uint32_t indices = blocks[4] | blocks[5] << 8 | blocks[6] << 16 | (uint32_t)blocks[7] << 24;
+            for(GLuint y = 0; y < 4 && by + y < size; y++)
+            for(GLuint x = 0; x < 4 && bx + x < size; x++)
+            memcpy(rgb + ((size_t)(by + y) * size + bx + x) * 3, palette[(indices >> (2 * (y * 4 + x))) & 3], 3);
+        }
+    }
+
+    // Encodes size x size RGB texels as DXT1 blocks: endpoints are the corners of the colors' bounding box (flipped
+    // along the channels that fall as green rises), inset a little, and each texel takes the nearest palette color
+    static void compressLevel(const GLubyte* rgb, GLuint size, GLubyte* blocks)
+    {
+        for(GLuint by = 0; by < size; by += 4)
+        for(GLuint bx = 0; bx < size; bx += 4, blocks += 8)
+        {
+            // Blocks hanging over the edge repeat the last row/column
+            GLint texels[16][3];
+            GLint low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+            for(GLuint i = 0; i < 16; i++)
+            {
+                const GLubyte* p = rgb + ((size_t)min(by + i / 4, size - 1) * size + min(bx + i % 4, size - 1)) * 3;
+                for(GLuint c = 0; c < 3; c++)
+                {
+                    texels[i][c] = p[c];
+                    low[c] = min(low[c], texels[i][c]);
+                    high[c] = max(high[c], texels[i][c]);
+                    mean[c] += texels[i][c];
+                }
+            }
+            GLint covariance[3] = { 0, 0, 0 };
+            for(GLuint i = 0; i < 16; i++)
+            for(GLuint c = 0; c < 3; c++)
+            covariance[c] += (texels[i][c] * 16 - mean[c]) * (texels[i][1] * 16 - mean[1]);
+            for(GLuint c = 0; c < 3; c++)
+            {
+                GLint inset = (high[c] - low[c]) / 16;
+                low[c] += inset;
+                high[c] -= inset;
+                if(covariance[c] < 0)
+                swap(low[c], high[c]);
+            }
+            GLushort c0 = pack565(high), c1 = pack565(low);
+            if(c0 < c1)
+            swap(c0, c1);
+            GLubyte palette[4][3];
+            expand565(c0, palette[0]);
+            expand565(c1, palette[1]);
+            for(GLuint c = 0; c < 3; c++)
+            {
+                palette[2][c] = (GLubyte)((2 * palette[0][c] + palette[1][c]) / 3);
+                palette[3][c] = (GLubyte)((palette[0][c] + 2 * palette[1][c]) / 3);
+            }
+            // c0 == c1 would select the three color mode; every texel then takes index 0, which is fine in both
+            uint32_t indices = 0;
+            for(GLuint i = 0; i < 16 && c0 != c1; i++)
+            {
+                GLint best = 0, bestDistance = 1 << 30;
+                for(GLint k = 0; k < 4; k++)
+                {
+                    GLint dr = texels[i][0] - palette[k][0], dg = texels[i][1] - palette[k][1], db = texels[i][2] - palette[k][2];
+                    GLint distance = dr * dr + dg * dg + db * db;
+                    if(distance < bestDistance)
+                    {
+                        best = k;
+                        bestDistance = distance;
+                    }
+                }
+                indices |= (uint32_t)best << (2 * i);
+            }
+            blocks[0] = (GLubyte)c0;
+            blocks[1] = (GLubyte)(c0 >> 8);
+            blocks[2] = (GLubyte)c1;
+            blocks[3] = (GLubyte)(c1 >> 8);
+            for(GLuint b = 0; b < 4; b++)
+            blocks[4 + b] = (GLubyte)(indices >> (8 * b));
+        }
+    }
+
+    private:
+    GLTexture cubemap;
+    GLVertexArray vertexArray;      // Core profile needs one bound, the triangle's corners come from gl_VertexID
+    GLVertexArray cubeArray;        // The cube DrawCube draws
+    GLBuffer cubeBuffer;
+    GLuint faceSize;
+    GLuint levels;
+    const GLubyte* data;            // Compressed faces until Upload, in blocks or in the cache mapping
+    size_t dataSize;
+    vector<GLubyte> blocks;
+    MappedFile cache;
+
+    static size_t levelBytes(GLuint size)
+    {
+        return (size_t)((size + 3) / 4) * ((size + 3) / 4) * 8;
+    }
+
+    static size_t levelOffset(GLuint faceSize, GLuint level)
+    {
+        size_t offset = 0;
+        for(GLuint i = 0; i < level; i++)
+        offset += levelBytes(max(faceSize >> i, 1u));
+        return offset;
+    }
+
+    size_t faceBytes() const
+    {
+        return levelOffset(this->faceSize, this->levels);
+    }
+
+    static GLushort pack565(const GLint rgb[3])
+    {
+        return (GLushort)((rgb[0] * 31 + 127) / 255 << 11 | (rgb[1] * 63 + 127) / 255 << 5 | (rgb[2] * 31 + 127) / 255);
+    }
+
+    static void expand565(GLushort color, GLubyte rgb[3])
+    {
+        GLuint r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+        rgb[0] = (GLubyte)(r << 3 | r >> 2);
+        rgb[1] = (GLubyte)(g << 2 | g >> 4);
+        rgb[2] = (GLubyte)(b << 3 | b >> 2);
+    }
+
+    void uploadCube()
+    {
+        // Two triangles per face, 6 faces
+        static const GLbyte corners[6][4][3] = {
+            { { -1, -1, -1 }, { 1, -1, -1 }, { 1, 1, -1 }, { -1, 1, -1 } }, { { -1, -1, 1 }, { -1, 1, 1 }, { 1, 1, 1 }, { 1, -1, 1 } },
+            { { -1, -1, -1 }, { -1, 1, -1 }, { -1, 1, 1 }, { -1, -1, 1 } }, { { 1, -1, -1 }, { 1, -1, 1 }, { 1, 1, 1 }, { 1, 1, -1 } },
+            { { -1, -1, -1 }, { -1, -1, 1 }, { 1, -1, 1 }, { 1, -1, -1 } }, { { -1, 1, -1 }, { 1, 1, -1 }, { 1, 1, 1 }, { -1, 1, 1 } } };
+        GLfloat vertices[36 * 3];
+        for(GLuint face = 0, v = 0; face < 6; face++)
+        for(GLuint corner : { 0, 1, 2, 2, 3, 0 })
+        for(GLuint c = 0; c < 3; c++)
+        vertices[v++] = corners[face][corner][c] * 10.0f;
+        this->cubeArray = GLVertexArray::Create();
+        this->cubeBuffer = GLBuffer::Create();
+        glBindVertexArray(this->cubeArray.Get());
+        glBindBuffer(GL_ARRAY_BUFFER, this->cubeBuffer.Get());
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        gpuResources().Track(RESOURCE_VERTEX_ARRAY, this->cubeArray.Get(), 0);
+        gpuResources().Track(RESOURCE_BUFFER, this->cubeBuffer.Get(), sizeof(vertices));
+    }
+
+    void release()
+    {
+        vector<GLubyte>().swap(this->blocks);
+        this->cache.Close();
+        this->data = nullptr;
+        this->dataSize = 0;
+    }
+
+    // Maps the cache file if it was built from these faces
+    bool readCache(const string& cachePath, uint64_t sourceHash)
+    {
+        if(!this->cache.Open(cachePath) || this->cache.Size() < sizeof(SkyboxCacheHeader))
+        return false;
+        SkyboxCacheHeader header;
+        memcpy(&header, this->cache.Data(), sizeof(header));
+        this->faceSize = header.faceSize;
+        this->levels = header.levels;
+        if(header.magic != SKYBOX_CACHE_MAGIC || header.version != SKYBOX_CACHE_VERSION || header.sourceHash != sourceHash
+           || header.levels == 0 || header.levels > 16 || header.dataSize != this->CompressedBytes()
+           || this->cache.Size() < sizeof(header) + header.dataSize)
+        {
+            this->cache.Close();
+            return false;
+        }
+        this->data = (const GLubyte*)this->cache.Data() + sizeof(header);
+        this->dataSize = header.dataSize;
+        this->timings.cached = true;
+        return true;
+    }
+
+    // Decodes the faces and compresses their mip chains, one face per job, then writes the cache file
+    bool build(const vector<string>& faces, const string& cachePath, uint64_t sourceHash, ThreadPool* pool)
+    {
+        auto start = chrono::steady_clock::now();
+        vector<TextureImage> images(faces.size());
+        auto decode = [&](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; i++)
+            images[i] = decodeImage(faces[i]);
+        };
+        if(pool)
+        pool->ParallelFor(faces.size(), 1, decode);
+        else
+        decode(0, faces.size());
+        auto decoded = chrono::steady_clock::now();
+        this->timings.decodeMs = chrono::duration<GLfloat, milli>(decoded - start).count();
+
+        this->faceSize = (GLuint)images[0].width;
+        for(const TextureImage& image : images)
+        if(!image.pixels || image.width != (int)this->faceSize || image.height != (int)this->faceSize)
+        {
+            cout << "ERROR::SKYBOX::FACES_NOT_SQUARE_OR_EQUAL" << endl;
+            return false;
+        }
+        this->levels = 1;
+        while((this->faceSize >> this->levels) > 0)
+        this->levels++;
+        this->blocks.resize(this->CompressedBytes());
+        auto compress = [&](size_t begin, size_t end)
+        {
+            for(size_t face = begin; face < end; face++)
+            {
+                // Each level is a 2x2 box filter of the one above (odd sizes drop the last row/column's half texel)
+                vector<GLubyte> level(images[face].pixels, images[face].pixels + (size_t)this->faceSize * this->faceSize * 3);
+                vector<GLubyte> next;
+                GLubyte* out = this->blocks.data() + face * this->faceBytes();
+                for(GLuint l = 0, size = this->faceSize; l < this->levels; l++, size = max(size / 2, 1u))
+                {
+                    compressLevel(level.data(), size, out);
+                    out += levelBytes(size);
+                    GLuint half = max(size / 2, 1u);
+                    next.resize((size_t)half * half * 3);
+                    for(GLuint y = 0; y < half; y++)
+                    for(GLuint x = 0; x < half; x++)
+                    for(GLuint c = 0; c < 3; c++)
+                    {
+                        GLuint x0 = min(x * 2, size - 1), x1 = min(x * 2 + 1, size - 1), y0 = min(y * 2, size - 1), y1 = min(y * 2 + 1, size - 1);
+                        next[((size_t)y * half + x) * 3 + c] = (GLubyte)((level[((size_t)y0 * size + x0) * 3 + c] + level[((size_t)y0 * size + x1) * 3 + c]
+                                                                          + level[((size_t)y1 * size + x0) * 3 + c] + level[((size_t)y1 * size + x1) * 3 + c] + 2) / 4);
+                    }
+                    level.swap(next);
+                }
+                images[face] = TextureImage();
+            }
+        };
+        if(pool)
+        pool->ParallelFor(faces.size(), 1, compress);
+        else
+        compress(0, faces.size());
+        this->timings.compressMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - decoded).count();
+        this->data = this->blocks.data();
+        this->dataSize = this->blocks.size();
+
+        // Written next to the final name and renamed into place, so a crash never leaves a half-written cache behind
+        SkyboxCacheHeader header = { SKYBOX_CACHE_MAGIC, SKYBOX_CACHE_VERSION, this->faceSize, this->levels, sourceHash, (uint64_t)this->dataSize };
+        string temporary = cachePath + ".tmp";
+        bool written;
+        {
+            ofstream out(temporary, ios::binary | ios::trunc);
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)this->data, this->dataSize);
+            out.close();
+            written = !out.fail();
+        }
+        if(!written || rename(temporary.c_str(), cachePath.c_str()) != 0)
+        {
+            cout << "ERROR::SKYBOX::CANNOT_WRITE_CACHE " << cachePath << endl;
+            remove(temporary.c_str());
+        }
+        // The faces are loaded either way, only the next start won't find them cached
+        return true;
+    }
+};
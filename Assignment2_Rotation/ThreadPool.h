@@ -0,0 +1,128 @@
+#pragma once
+// Std. Includes
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+using namespace std;
+
+// A fixed set of worker threads for data-parallel loops. The calling thread takes part in the work as well,
+// so a pool with zero workers simply runs everything inline.
+class ThreadPool
+{
+    public:
+    // Constructor, defaults to one worker per hardware thread besides the caller
+    ThreadPool(unsigned int workerCount = defaultWorkerCount()) : job(nullptr), jobCount(0), jobGrain(1), next(0), pending(0), generation(0), stop(false)
+    {
+        for(unsigned int i = 0; i < workerCount; i++)
+            this->workers.push_back(thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(this->mutex_);
+            this->stop = true;
+        }
+        this->wake.notify_all();
+        for(size_t i = 0; i < this->workers.size(); i++)
+            this->workers[i].join();
+    }
+
+    // Splits [0, count) into chunks of at most grain items and calls fn(begin, end) for each chunk on all threads.
+    // Returns once every chunk has been processed. Must not be called from inside fn.
+    void ParallelFor(size_t count, size_t grain, const function<void(size_t, size_t)>& fn)
+    {
+        if(count == 0)
+            return;
+        grain = max<size_t>(grain, 1);
+        if(this->workers.empty() || count <= grain)
+        {
+            fn(0, count);
+            return;
+        }
+        lock_guard<mutex> serial(this->submitMutex);
+        {
+            lock_guard<mutex> lock(this->mutex_);
+            this->job = &fn;
+            this->jobCount = count;
+            this->jobGrain = grain;
+            this->next = 0;
+            this->pending = this->workers.size();
+            this->generation++;
+        }
+        this->wake.notify_all();
+        this->runChunks();
+        unique_lock<mutex> lock(this->mutex_);
+        this->finished.wait(lock, [this] { return this->pending == 0; });
+        this->job = nullptr;
+    }
+
+    size_t WorkerCount() const
+    {
+        return this->workers.size();
+    }
+
+    static unsigned int defaultWorkerCount()
+    {
+        unsigned int hw = thread::hardware_concurrency();
+        return hw > 1 ? hw - 1 : 0;
+    }
+
+    private:
+    vector<thread> workers;
+    mutex mutex_;
+    mutex submitMutex;
+    condition_variable wake;
+    condition_variable finished;
+    const function<void(size_t, size_t)>* job;
+    size_t jobCount;
+    size_t jobGrain;
+    atomic<size_t> next;
+    size_t pending;
+    unsigned long generation;
+    bool stop;
+
+    // Claims chunks of the current job until none are left
+    void runChunks()
+    {
+        for(;;)
+        {
+            size_t begin = this->next.fetch_add(this->jobGrain);
+            if(begin >= this->jobCount)
+                break;
+            (*this->job)(begin, min(begin + this->jobGrain, this->jobCount));
+        }
+    }
+
+    void workerLoop()
+    {
+        unsigned long seen = 0;
+        for(;;)
+        {
+            {
+                unique_lock<mutex> lock(this->mutex_);
+                this->wake.wait(lock, [this, seen] { return this->stop || this->generation != seen; });
+                if(this->stop)
+                    return;
+                seen = this->generation;
+            }
+            this->runChunks();
+            {
+                lock_guard<mutex> lock(this->mutex_);
+                if(--this->pending == 0)
+                    this->finished.notify_one();
+            }
+        }
+    }
+};
+
+// Shared pool used by the loaders and per-frame systems
+inline ThreadPool& workerPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
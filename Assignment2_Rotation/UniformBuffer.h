@@ -0,0 +1,192 @@
+#pragma once
+// Std. Includes
+#include <cstring>
+#include <iostream>
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "GLHandle.h"
+
+// std140 layouts of the shared uniform blocks. Only mat4/vec4 members, so the C++ and GLSL layouts match without padding.
+struct CameraBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 viewProjection;
+    glm::vec4 position;         // World space camera position, w unused
+    glm::mat4 skyInverseViewProjection;     // Inverse of projection * view without the view's translation, for the sky's view rays
+};
+
+struct ObjectBlock {
+    glm::mat4 model;
+};
+
+// Streams per-frame uniform data through one buffer split into frameCount regions.
+// Each region is protected by a fence so the CPU never overwrites data the GPU may still read.
+// With ARB_buffer_storage the buffer is mapped persistently once; otherwise each region is mapped unsynchronized
+// while being written, and the whole buffer is orphaned instead of stalling when the region's fence hasn't passed yet.
+class UniformRingBuffer
+{
+    public:
+    UniformRingBuffer(GLsizeiptr regionSize = 256 * 1024, GLuint frameCount = 3)
+    : regionSize(regionSize), frameCount(frameCount), frame(0), regionStart(0), cursor(0), mapStart(0), mapped(nullptr), persistentBase(nullptr), persistent(false)
+    {
+        GLint alignment;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        this->alignment = alignment > 0 ? alignment : 256;
+        this->regionSize = this->align(regionSize);
+        for(GLuint i = 0; i < MAX_FRAMES; i++)
+            this->fences[i] = 0;
+        if(this->frameCount > MAX_FRAMES)
+            this->frameCount = MAX_FRAMES;
+
+        this->buffer = GLBuffer::Create();
+        glBindBuffer(GL_UNIFORM_BUFFER, this->buffer.Get());
+        GLsizeiptr size = this->regionSize * this->frameCount;
+        if(GLEW_ARB_buffer_storage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+            this->persistentBase = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+            this->persistent = this->persistentBase != nullptr;
+        }
+        else
+            glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        gpuResources().Track(RESOURCE_BUFFER, this->buffer.Get(), size);
+    }
+
+    ~UniformRingBuffer()
+    {
+        for(GLuint i = 0; i < MAX_FRAMES; i++)
+            if(this->fences[i])
+                glDeleteSync(this->fences[i]);
+        if(this->buffer && (this->persistent || this->mapped))
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, this->buffer.Get());
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+    }
+
+    UniformRingBuffer(const UniformRingBuffer&) = delete;
+    UniformRingBuffer& operator=(const UniformRingBuffer&) = delete;
+
+    // Moves to the next region, waiting for (or orphaning around) the GPU if it's still reading it
+    void BeginFrame()
+    {
+        GLuint region = this->frame % this->frameCount;
+        this->regionStart = region * this->regionSize;
+        this->cursor = this->regionStart;
+        GLsync& fence = this->fences[region];
+        if(fence)
+        {
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            if(status == GL_TIMEOUT_EXPIRED && !this->persistent)
+            {
+                // Let the driver hand us fresh storage rather than wait. All old regions become unreachable.
+                glBindBuffer(GL_UNIFORM_BUFFER, this->buffer.Get());
+                glBufferData(GL_UNIFORM_BUFFER, this->regionSize * this->frameCount, NULL, GL_STREAM_DRAW);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                for(GLuint i = 0; i < MAX_FRAMES; i++)
+                    if(this->fences[i])
+                    {
+                        glDeleteSync(this->fences[i]);
+                        this->fences[i] = 0;
+                    }
+            }
+            else
+            {
+                while(status == GL_TIMEOUT_EXPIRED)
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                glDeleteSync(fence);
+                fence = 0;
+            }
+        }
+    }
+
+    // Copies size bytes into the current region and returns their offset in the buffer, or -1 if the region is full
+    GLintptr Push(const void* data, GLsizeiptr size)
+    {
+        GLintptr offset = this->cursor;
+        if(offset + size > this->regionStart + this->regionSize)
+        {
+            cout << "ERROR::UNIFORM_RING::REGION_FULL " << this->regionSize << " bytes" << endl;
+            return -1;
+        }
+        char* target;
+        if(this->persistent)
+            target = this->persistentBase + offset;
+        else
+        {
+            if(!this->mapped)
+            {
+                // The fence guarantees the GPU is done with this region, so no implicit synchronization is needed
+                glBindBuffer(GL_UNIFORM_BUFFER, this->buffer.Get());
+                this->mapStart = offset;
+                this->mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, offset, this->regionStart + this->regionSize - offset,
+                                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            }
+            target = this->mapped + (offset - this->mapStart);
+        }
+        memcpy(target, data, size);
+        this->cursor = this->align(offset + size);
+        return offset;
+    }
+
+    // Makes everything pushed so far visible to the GPU. Call before drawing with the pushed data.
+    void Flush()
+    {
+        if(this->mapped)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, this->buffer.Get());
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            this->mapped = nullptr;
+        }
+    }
+
+    // Binds a pushed range to one of the fixed binding points
+    void Bind(GLuint binding, GLintptr offset, GLsizeiptr size) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, this->buffer.Get(), offset, size);
+    }
+
+    // Fences the region after the frame's last draw that reads it
+    void EndFrame()
+    {
+        this->Flush();
+        GLuint region = this->frame % this->frameCount;
+        this->fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        this->frame++;
+    }
+
+    // Bytes written during the current frame
+    GLsizeiptr BytesThisFrame() const
+    {
+        return this->cursor - this->regionStart;
+    }
+
+    private:
+    static const GLuint MAX_FRAMES = 4;
+
+    GLBuffer buffer;
+    GLsizeiptr regionSize;
+    GLuint frameCount;
+    GLuint frame;
+    GLintptr regionStart;
+    GLintptr cursor;
+    GLintptr mapStart;
+    char* mapped;
+    char* persistentBase;
+    bool persistent;
+    GLint alignment;
+    GLsync fences[MAX_FRAMES];
+
+    GLintptr align(GLintptr offset) const
+    {
+        return (offset + this->alignment - 1) / this->alignment * this->alignment;
+    }
+};
@@ -25,6 +25,16 @@
 #include "Shader.h"
 #include "Camera.h"
 #include "Model.h"
+#include "Benchmark.h"
+#include "DynamicResolution.h"
+#include "FrameArena.h"
+#include "AllocationTracker.h"
+#include "InitScheduler.h"
+#include "OcclusionCuller.h"
+#include "GpuTimer.h"
+#include "FramePacer.h"
+#include "GpuResources.h"
+#include "Skybox.h"
 
 using namespace std;
 
@@ -37,9 +47,11 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void do_movement();
 GLuint loadTexture(GLchar* path, GLboolean alpha = false);
-GLuint loadCubemap(vector<const GLchar*> faces);
 glm::mat4 toEuler(GLfloat yaw, GLfloat pitch, GLfloat roll);
 glm::mat4 toQuaternion(GLfloat x, GLfloat y, GLfloat z);
+struct Scene;
+GLFWwindow* createWindow();
+int runScene(GLFWwindow* window, Scene& scene, const InitScheduler& init);
 
 // Camera
 Camera  camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -64,8 +76,163 @@ glm::mat4 modelMatrix, viewMatrix;
 
 bool firstPerson = false;
 
+// Everything the game loop draws. Filled in by the startup tasks and destroyed before the GL context.
+struct Scene {
+    Shader shader;
+    Shader skyboxShader;
+    Shader skyboxCubeShader;    // The old cube sky, to compare fill cost
+    Model plane;
+    Skybox skybox;
+
+    // Meshes can only be evicted if they keep their geometry to upload it again
+    explicit Scene(Geometry_Storage storage) : plane(storage) { }
+};
+
+// Count heap allocations and report the startup total and frames that allocate (--track-allocations)
+bool trackAllocations = false;
+// Allocation self-check: run a fixed number of frames and fail if any frame after the warmup used the heap
+bool checkAllocations = false;
+
+// CPU occlusion culling of the model's meshes, toggled with C to compare its cost and savings
+bool occlusionCulling = true;
+// Back-facing meshlet culling inside the visible meshes, toggled with B
+bool meshletCulling = true;
+// Draw the sky as the old 36 vertex cube instead of the fullscreen triangle, toggled with X to compare their fill cost
+bool skyCube = false;
+
+// Frame pacing: frames the CPU may queue ahead of the GPU (P cycles 1-3) and a frame rate cap (F cycles off/60/30).
+// Set from the command line with --frames-in-flight <n> and --fps <hz>.
+GLuint framesInFlight = 2;
+GLfloat targetFps = 0.0f;
+// VRAM budget in MB for gpuResources(), 0 for none. Set with --vram-budget <MB>, which also keeps the model's
+// geometry in system memory so its buffers can be evicted too.
+GLfloat vramBudgetMB = 0.0f;
+const GLuint ALLOCATION_WARMUP_FRAMES = 120;
+const GLuint ALLOCATION_CHECK_FRAMES = 600;
+
 // The MAIN function, from here we start the application and run the game loop
-int main()
+int main(int argc, char* argv[])
+{
+    InitScheduler::Clock::time_point startTime = InitScheduler::Clock::now();
+    if(argc > 2 && string(argv[1]) == "--bench")
+        return runBenchmark(argv[2], vector<string>(argv + 3, argv + argc));
+    // Asset packing tool: --pack <archive> <files or directories...>
+    if(argc > 3 && string(argv[1]) == "--pack")
+        return writeAssetArchive(argv[2], vector<string>(argv + 3, argv + argc)) ? 0 : -1;
+    for(int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if(option == "--check-allocations")
+            checkAllocations = trackAllocations = true;
+        else if(option == "--track-allocations")
+            trackAllocations = true;
+        else if(option == "--frames-in-flight" && i + 1 < argc)
+            framesInFlight = (GLuint)atoi(argv[++i]);
+        else if(option == "--fps" && i + 1 < argc)
+            targetFps = (GLfloat)atof(argv[++i]);
+        else if(option == "--vram-budget" && i + 1 < argc)
+            vramBudgetMB = (GLfloat)atof(argv[++i]);
+    }
+    gpuResources().SetBudget((size_t)(vramBudgetMB * 1048576.0f));
+    // Off by default: with tracking on, every allocation in the process also updates the shared counters
+    AllocationTracker::Enable(trackAllocations);
+    AllocationScope startup;
+
+    // Serve assets from the pack when one has been built, loose files are used for anything it doesn't contain
+    if(assetArchive().Open("assets.pak"))
+        cout << "Using asset archive assets.pak (" << assetArchive().EntryCount() << " files)" << endl;
+
+    GLFWwindow* window = nullptr;
+    int result = -1;
+    {
+        // GL objects are owned by the scene and released at the end of this block, while the context still exists
+        Scene scene(vramBudgetMB > 0.0f ? GPU_AND_CPU : GPU_ONLY);
+        vector<string> faces;
+        faces.push_back("skybox/xpos.jpg");
+        faces.push_back("skybox/xneg.jpg");
+        faces.push_back("skybox/ypos.jpg");
+        faces.push_back("skybox/yneg.jpg");
+        faces.push_back("skybox/zpos.jpg");
+        faces.push_back("skybox/zneg.jpg");
+
+        // Startup as a dependency graph: decoding and importing start right away on worker threads, while the main
+        // thread creates the context and gets the shader compiles going, then uploads whatever has finished.
+        InitScheduler init(startTime);
+        size_t importSkybox = init.Add("import skybox", INIT_WORKER, {}, [&]
+        {
+            // A sky that fails to load is reported and drawn black
+            scene.skybox.Import(faces, "skybox/skybox.cube");
+            return true;
+        });
+        size_t importModel = init.Add("import model", INIT_WORKER, {}, [&]
+        {
+            // A model that fails to load is reported and left empty, like before
+            scene.plane.Import("Heli/heli.obj");
+            return true;
+        });
+        size_t createContext = init.Add("create context", INIT_MAIN, {}, [&]
+        {
+            window = createWindow();
+            return window != nullptr;
+        });
+        size_t compileShaders = init.Add("compile shaders", INIT_MAIN, { createContext }, [&]
+        {
+            Shader::EnableParallelCompile();
+            scene.shader.Compile("diffuse.vs", "diffuse.frag");
+            scene.skyboxShader.Compile("skybox.vs", "skybox.frag");
+            scene.skyboxCubeShader.Compile("skybox_cube.vs", "skybox.frag");
+            return true;
+        });
+        init.Add("upload skybox", INIT_MAIN, { createContext, importSkybox }, [&]
+        {
+            scene.skybox.Upload();
+            return true;
+        });
+        init.Add("upload model", INIT_MAIN, { createContext, importModel }, [&]
+        {
+            scene.plane.Upload();
+            return true;
+        });
+        init.Add("link shaders", INIT_MAIN, { compileShaders }, [&]
+        {
+            scene.shader.Finish();
+            scene.skyboxShader.Finish();
+            Skybox::SetupShader(scene.skyboxShader);
+            scene.skyboxCubeShader.Finish();
+            Skybox::SetupShader(scene.skyboxCubeShader);
+            return true;
+        });
+        bool initialized = init.Run();
+        init.PrintTimeline(cout);
+
+        if(initialized)
+        {
+            scene.plane.MemoryUsage().Print(cout, "Heli/heli.obj");
+            const SkyboxTimings& sky = scene.skybox.timings;
+            cout << "SKYBOX::LOAD " << (sky.cached ? "cached" : "built") << " in " << fixed << setprecision(1) << sky.loadMs << " ms (hash " << sky.hashMs
+                 << " ms, decode " << sky.decodeMs << " ms, compress " << sky.compressMs << " ms), " << scene.skybox.CompressedBytes() / 1024 << " KB" << endl;
+            GpuResourceReport vram = gpuResources().Report();
+            vram.Print(cout);
+            // Buffers in use every frame are never evicted, but with nothing evictable at all the budget can't be met
+            if(vram.budgetBytes > 0 && vram.residentBytes > vram.budgetBytes && vram.evictableBytes[RESOURCE_BUFFER] == 0)
+                cout << "ERROR::VRAM::NO_EVICTABLE_MESHES over the budget, but no mesh keeps the geometry to restore its buffers" << endl;
+            if(trackAllocations)
+            {
+                AllocationStats startupAllocations = startup.Delta();
+                cout << "ALLOCATIONS::STARTUP " << startupAllocations.count << " allocations, " << startupAllocations.bytes / 1024 << " KB" << endl;
+            }
+            result = runScene(window, scene, init);
+        }
+    }
+    // Everything the scene owned is queued for deletion now; carry it out while the context still exists
+    if(window)
+        gpuResources().Flush();
+    glfwTerminate();
+    return result;
+}
+
+// Opens the window and creates its GL context, returns nullptr on failure
+GLFWwindow* createWindow()
 {
     // Init GLFW
     glfwInit();
@@ -75,106 +242,75 @@ int main()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint( GLFW_RESIZABLE, GL_FALSE );
-    
+
     // Create a GLFWwindow object that we can use for GLFW's functions
     GLFWwindow *window = glfwCreateWindow(WIDTH, HEIGHT, "Realtime Hatching", nullptr, nullptr);
     if(window == nullptr){
         cout << "Failed to open GLFW window." << endl;
-        glfwTerminate();
-        return -1;
+        return nullptr;
     }
     glfwMakeContextCurrent(window);
-    
+
     glfwGetFramebufferSize(window, &SCREEN_WIDTH, &SCREEN_HEIGHT);
     // Set the required callback functions
     glfwSetKeyCallback(window, key_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
-    
+
     // GLFW Options
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    
+
     // Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
     glewExperimental = GL_TRUE;
     // Initialize GLEW to setup the OpenGL Function pointers
     if(glewInit() != GLEW_OK){
         cout << "Failed to initialize GLEW" << endl;
-        return -1;
+        return nullptr;
     }
-    
+
     // OpenGL options
     glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
     glEnable(GL_DEPTH_TEST);
-    
-    GLfloat skyboxVertices[] = {
-        // Positions
-        -10.0f,  10.0f, -10.0f,
-        -10.0f, -10.0f, -10.0f,
-        10.0f, -10.0f, -10.0f,
-        10.0f, -10.0f, -10.0f,
-        10.0f,  10.0f, -10.0f,
-        -10.0f,  10.0f, -10.0f,
-        
-        -10.0f, -10.0f,  10.0f,
-        -10.0f, -10.0f, -10.0f,
-        -10.0f,  10.0f, -10.0f,
-        -10.0f,  10.0f, -10.0f,
-        -10.0f,  10.0f,  10.0f,
-        -10.0f, -10.0f,  10.0f,
-        
-        10.0f, -10.0f, -10.0f,
-        10.0f, -10.0f,  10.0f,
-        10.0f,  10.0f,  10.0f,
-        10.0f,  10.0f,  10.0f,
-        10.0f,  10.0f, -10.0f,
-        10.0f, -10.0f, -10.0f,
-        
-        -10.0f, -10.0f,  10.0f,
-        -10.0f,  10.0f,  10.0f,
-        10.0f,  10.0f,  10.0f,
-        10.0f,  10.0f,  10.0f,
-        10.0f, -10.0f,  10.0f,
-        -10.0f, -10.0f,  10.0f,
-        
-        -10.0f,  10.0f, -10.0f,
-        10.0f,  10.0f, -10.0f,
-        10.0f,  10.0f,  10.0f,
-        10.0f,  10.0f,  10.0f,
-        -10.0f,  10.0f,  10.0f,
-        -10.0f,  10.0f, -10.0f,
-        
-        -10.0f, -10.0f, -10.0f,
-        -10.0f, -10.0f,  10.0f,
-        10.0f, -10.0f, -10.0f,
-        10.0f, -10.0f, -10.0f,
-        -10.0f, -10.0f,  10.0f,
-        10.0f, -10.0f,  10.0f
-    };
-    
-    GLuint skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-    glBindVertexArray(0);
-
-    vector<const GLchar*> faces;
-    faces.push_back("skybox/xpos.jpg");
-    faces.push_back("skybox/xneg.jpg");
-    faces.push_back("skybox/ypos.jpg");
-    faces.push_back("skybox/yneg.jpg");
-    faces.push_back("skybox/zpos.jpg");
-    faces.push_back("skybox/zneg.jpg");
-    GLuint skyboxTexture = loadCubemap(faces);
-    
-    Shader shader("diffuse.vs", "diffuse.frag");
-    Shader skyboxShader("skybox.vs", "skybox.frag");
-    Model plane("Heli/heli.obj");
+    // LEQUAL for everything, so the sky at exactly the far plane passes where nothing else was drawn
+    glDepthFunc(GL_LEQUAL);
+    return window;
+}
+
+// Runs the game loop until the window is closed
+int runScene(GLFWwindow* window, Scene& scene, const InitScheduler& init)
+{
+    // Per-frame uniform data (camera block, model matrices) for all programs is streamed through this buffer
+    UniformRingBuffer frameUniforms;
+    // Scene is rendered offscreen at a scale that keeps the GPU frame time on target, then upscaled to the window
+    DynamicResolution resolution(SCREEN_WIDTH, SCREEN_HEIGHT, 16.6f, 0.5f, 1.0f);
+    GLfloat lastTelemetry = 0.0f;
+    // Plays the model's first animation (if it has any) on its nodes
+    AnimationSampler animator(scene.plane.animations.empty() ? nullptr : &scene.plane.animations[0], 1);
+    // Occluders are rasterized at a low resolution with the window's aspect ratio
+    OcclusionCuller culler(256, max(8, 256 * SCREEN_HEIGHT / max(1, SCREEN_WIDTH)));
+    // GPU time of the model pass, averaged separately with culling on [1] and off [0]
+    GpuTimer modelTimer;
+    GLfloat modelGpuMs[2] = { 0.0f, 0.0f };
+    // GPU time of the sky, i.e. its fill cost, averaged separately for the triangle [0] and the old cube [1]
+    GpuTimer skyTimer;
+    GLfloat skyGpuMs[2] = { 0.0f, 0.0f };
+    bool timedCulling = occlusionCulling;
+    bool timedSkyCube = skyCube;
+    // Caps how many frames are queued on the GPU, so input is never sampled more than that many frames early
+    FramePacer pacer(framesInFlight, targetFps);
+    GLuint frameNumber = 0;
+    GLuint allocatingFrames = 0;
+    AllocationStats steadyAllocations = { 0, 0 };
     
     // Game loop
     while(!glfwWindowShouldClose(window)) {
+        AllocationScope frameAllocations;
+        frameArena().Reset();
+        // Wait for the GPU (and the rate cap) before reading the clock and input, so both are as fresh as possible
+        if(pacer.MaxFramesInFlight() != framesInFlight)
+            pacer.SetMaxFramesInFlight(framesInFlight);
+        if(pacer.TargetRate() != targetFps)
+            pacer.SetTargetRate(targetFps);
+        pacer.BeginFrame();
         // Calculate deltatime of current frame
         GLfloat currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
@@ -183,13 +319,13 @@ int main()
         glfwPollEvents();
         do_movement();
         
+        resolution.BeginFrame();
         glClearColor(0.45f, 0.78f, 0.9f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
         
-        shader.Use();
+        frameUniforms.BeginFrame();
         
         glm::mat4 projection = glm::perspective( camera.GetZoom( ), ( float )SCREEN_WIDTH/( float )SCREEN_HEIGHT, 0.1f, 100.0f );
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
         
         if(euler)
             modelMatrix = toEuler(Yaw, Pitch, Roll);
@@ -200,8 +336,6 @@ int main()
             modelMatrix *= model;
         }
         
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
-        
         glm::mat4 view;
         if(firstPerson){
             view = glm::translate(modelMatrix, glm::vec3(0, 0.2f, 0.95f));
@@ -211,25 +345,138 @@ int main()
         else
             view = camera.GetViewMatrix();
         
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        plane.Draw(shader);
+        // Camera data is written once and bound once, every program reads it through its Camera block
+        CameraBlock cameraBlock;
+        cameraBlock.projection = projection;
+        cameraBlock.view = view;
+        cameraBlock.viewProjection = projection * view;
+        cameraBlock.position = glm::vec4(camera.GetPosition(), 1.0f);
+        // Without the translation the rays start at the eye, and the far plane stays out of the inverse's precision trouble
+        cameraBlock.skyInverseViewProjection = glm::inverse(projection * glm::mat4(glm::mat3(view)));
+        GLintptr cameraOffset = frameUniforms.Push(&cameraBlock, sizeof(CameraBlock));
+        frameUniforms.Bind(UNIFORM_BINDING_CAMERA, cameraOffset, sizeof(CameraBlock));
+        
+        animator.Advance(deltaTime);
+        animator.Sample();
+        animator.Apply(0, scene.plane.nodes);
+        // Morph weights have no animation channels yet, so each target fades in and out on its own phase
+        for(MeshDeformer& deformer : scene.plane.deformers)
+            for(GLuint k = 0; k < deformer.weights.size(); k++)
+                deformer.weights[k] = 0.5f + 0.5f * sin(currentFrame * 1.5f + k);
+        scene.plane.Deform(currentFrame);
         
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.Use();
-        glUniformMatrix4fv(glGetUniformLocation(skyboxShader.Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(skyboxShader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.Program, "skybox"), 0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
+        // Meshes hidden behind the occluders (or outside the frustum) are skipped by the next Draw
+        if(occlusionCulling)
+        {
+            culler.BeginFrame(cameraBlock.viewProjection);
+            scene.plane.SubmitOccluders(culler, modelMatrix);
+            culler.Rasterize();
+            scene.plane.Cull(culler, modelMatrix);
+        }
+        if(timedCulling != occlusionCulling)
+        {
+            modelTimer.ResetAverage();
+            timedCulling = occlusionCulling;
+        }
+        
+        scene.shader.Use();
+        modelTimer.Begin();
+        // Meshlets are tested against the eye the view matrix was built from, which in first person isn't the camera's
+        glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+        scene.plane.Draw(scene.shader, modelMatrix, frameUniforms, meshletCulling ? &eye : nullptr);
+        modelTimer.End();
+        modelGpuMs[occlusionCulling] = modelTimer.SmoothedMs();
+        
+        // Sky last, only the pixels the model left at the far plane get shaded
+        if(timedSkyCube != skyCube)
+        {
+            skyTimer.ResetAverage();
+            timedSkyCube = skyCube;
+        }
+        skyTimer.Begin();
+        if(skyCube)
+        {
+            scene.skyboxCubeShader.Use();
+            scene.skybox.DrawCube();
+        }
+        else
+        {
+            scene.skyboxShader.Use();
+            scene.skybox.Draw();
+        }
+        skyTimer.End();
+        skyGpuMs[skyCube] = skyTimer.SmoothedMs();
+        resolution.EndFrame();
+        frameUniforms.EndFrame();
+        
+        // Show the resolution controller's and the culler's state in the title bar
+        if(currentFrame - lastTelemetry > 0.5f)
+        {
+            const ResolutionTelemetry& t = resolution.Telemetry();
+            const OcclusionStats& c = culler.Stats();
+            const MeshletStats& m = scene.plane.meshletStats;
+            FramePacingStats p = pacer.Stats();
+            char title[512];
+            int length = snprintf(title, sizeof(title), "Realtime Hatching - %dx%d (%.0f%%) GPU %.2f ms / %.1f ms", t.renderWidth, t.renderHeight, t.scale * 100.0f, t.smoothedGpuMs, t.targetMs);
+            if(occlusionCulling)
+                length += snprintf(title + length, sizeof(title) - length, " | culled %u+%u/%u (%u tris) CPU %.2f ms, model GPU %.2f ms (off %.2f ms)",
+                         c.occluded, c.frustumCulled, c.tested, c.occludedTriangles, c.rasterMs + c.testMs, modelGpuMs[1], modelGpuMs[0]);
+            else
+                length += snprintf(title + length, sizeof(title) - length, " | culling off, model GPU %.2f ms (on %.2f ms)", modelGpuMs[0], modelGpuMs[1]);
+            length = min(length, (int)sizeof(title) - 1);
+            length += snprintf(title + length, sizeof(title) - length, " | %u in flight (queue %.1f) %.2f +/- %.2f ms",
+                               pacer.MaxFramesInFlight(), p.queueDepth, p.intervalMs, p.jitterMs);
+            length = min(length, (int)sizeof(title) - 1);
+            const DeformStats& d = scene.plane.deformStats;
+            if(!scene.plane.deformers.empty())
+                length += snprintf(title + length, sizeof(title) - length, " | deform %u verts %.0f/ms, %.2f MB/frame (%.0f MB/s)",
+                                   d.vertices, d.vertices / max(d.deformMs, 1e-3f), d.bytes / 1048576.0f, d.bytes / 1048576.0f * 1000.0f / max(p.intervalMs, 1e-3f));
+            length = min(length, (int)sizeof(title) - 1);
+            length += snprintf(title + length, sizeof(title) - length, " | VRAM %.1f/%.0f MB | sky GPU %.3f ms (%s, %s %.3f ms)",
+                               gpuResources().ResidentBytes() / 1048576.0f, vramBudgetMB, skyGpuMs[skyCube], skyCube ? "cube" : "triangle",
+                               skyCube ? "triangle" : "cube", skyGpuMs[!skyCube]);
+            length = min(length, (int)sizeof(title) - 1);
+            if(meshletCulling)
+                snprintf(title + length, sizeof(title) - length, " | meshlets -%u/%u (-%u/%u tris) in %u draws",
+                         m.culledMeshlets, m.meshlets, m.culledTriangles, m.triangles, m.draws);
+            glfwSetWindowTitle(window, title);
+            lastTelemetry = currentFrame;
+        }
         
         glfwSwapBuffers(window);
+        pacer.EndFrame();
+        gpuResources().EndFrame();
+        if(frameNumber == 0)
+            cout << "STARTUP::FIRST_FRAME " << fixed << setprecision(1) << init.ElapsedMs() << " ms" << endl;
+        
+        // After the warmup every cache and arena block has reached its final size, so a frame should never allocate
+        frameNumber++;
+        AllocationStats frame = frameAllocations.Delta();
+        if(trackAllocations && frameNumber > ALLOCATION_WARMUP_FRAMES && frame.count > 0)
+        {
+            if(allocatingFrames == 0)
+                cout << "ALLOCATIONS::FRAME " << frameNumber << " made " << frame.count << " allocations (" << frame.bytes << " bytes)" << endl;
+            allocatingFrames++;
+            steadyAllocations.count += frame.count;
+            steadyAllocations.bytes += frame.bytes;
+        }
+        if(checkAllocations && frameNumber == ALLOCATION_WARMUP_FRAMES + ALLOCATION_CHECK_FRAMES)
+            glfwSetWindowShouldClose(window, GL_TRUE);
+    }
+    
+    FramePacingStats pacing = pacer.Stats();
+    cout << "FRAME_PACING " << pacer.MaxFramesInFlight() << " frames in flight, interval " << fixed << setprecision(2) << pacing.intervalMs
+         << " ms +/- " << pacing.jitterMs << " (worst " << pacing.maxIntervalMs << "), queue depth " << pacing.queueDepth << " (max " << pacing.maxQueueDepth
+         << "), waits: GPU " << pacing.fenceWaitMs << " ms, rate cap " << pacing.limiterWaitMs << " ms" << endl;
+    cout << "SKYBOX::FILL triangle " << skyGpuMs[0] << " ms, cube " << skyGpuMs[1] << " ms GPU per frame (0 if never drawn, X toggles)" << endl;
+    gpuResources().Report().Print(cout);
+    
+    if(checkAllocations)
+    {
+        cout << "ALLOCATIONS::STEADY_STATE " << allocatingFrames << " of " << frameNumber - min(frameNumber, ALLOCATION_WARMUP_FRAMES) << " frames allocated, "
+             << steadyAllocations.count << " allocations, " << steadyAllocations.bytes << " bytes, frame arena peak " << frameArena().HighWater() << " bytes" << endl;
+        return allocatingFrames == 0 && frameNumber >= ALLOCATION_WARMUP_FRAMES + ALLOCATION_CHECK_FRAMES ? 0 : 1;
     }
-    glfwTerminate();
     return 0;
 }
 
@@ -238,6 +485,16 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 {
     if ( GLFW_KEY_ESCAPE == key && GLFW_PRESS == action )
         glfwSetWindowShouldClose(window, GL_TRUE);
+    if ( GLFW_KEY_C == key && GLFW_PRESS == action )
+        occlusionCulling = !occlusionCulling;
+    if ( GLFW_KEY_B == key && GLFW_PRESS == action )
+        meshletCulling = !meshletCulling;
+    if ( GLFW_KEY_P == key && GLFW_PRESS == action )
+        framesInFlight = framesInFlight % 3 + 1;
+    if ( GLFW_KEY_F == key && GLFW_PRESS == action )
+        targetFps = targetFps == 0.0f ? 60.0f : (targetFps == 60.0f ? 30.0f : 0.0f);
+    if ( GLFW_KEY_X == key && GLFW_PRESS == action )
+        skyCube = !skyCube;
     
     if ( key >= 0 && key < 1024 )
         if ( action == GLFW_PRESS )
@@ -325,50 +582,12 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
-GLuint loadCubemap(vector<const GLchar*> faces)
-{
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    
-    int width,height;
-    unsigned char* image;
-    
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-    for(GLuint i = 0; i < faces.size(); i++)
-    {
-        image = SOIL_load_image(faces[i], &width, &height, 0, SOIL_LOAD_RGB);
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        SOIL_free_image_data(image);
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-    
-    return textureID;
-}
-
 GLuint loadTexture(GLchar* path)
 {
-    //Generate texture ID and load texture data
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    int width,height;
-    unsigned char* image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGB);
-    // Assign texture to ID
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    
-    // Parameters
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SOIL_free_image_data(image);
+    //Generate texture ID and load texture data (tracked and evictable like the model's textures)
+    TextureImage image = decodeImage(path);
+    GLuint textureID = uploadTexture(image);
+    setTextureEvictable(textureID, path, false);
     return textureID;
 }
 
@@ -1,10 +1,10 @@
 #version 330 core
-in vec3 TexCoords;
+in vec3 Direction;
 out vec4 color;
 
 uniform samplerCube skybox;
 
 void main()
 {
-    color = texture(skybox, TexCoords);
+    color = texture(skybox, Direction);
 }
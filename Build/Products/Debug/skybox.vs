@@ -1,13 +1,20 @@
 #version 330 core
-layout (location = 0) in vec3 position;
-out vec3 TexCoords;
-
-uniform mat4 projection;
-uniform mat4 view;
+out vec3 Direction;
 
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    mat4 skyInverseViewProjection;  // Inverse of projection * view without the view's translation
+};
 
 void main()
 {
-    gl_Position =   projection * view * vec4(position, 1.0);
-    TexCoords = position;
+    // One triangle covering the screen, (-1,-1) (3,-1) (-1,3), on the far plane
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    gl_Position = vec4(corner, 1.0, 1.0);
+    // Linear in the corner, so interpolating it per pixel gives each pixel's exact view ray
+    Direction = (skyInverseViewProjection * vec4(corner, 1.0, 1.0)).xyz;
 }
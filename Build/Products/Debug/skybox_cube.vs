@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 position;
+out vec3 Direction;
+
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    mat4 skyInverseViewProjection;
+};
+
+// The sky as it was drawn before the fullscreen triangle, kept to compare their fill cost
+void main()
+{
+    gl_Position = viewProjection * vec4(position, 1.0);
+    Direction = position;
+}